@@ -0,0 +1,186 @@
+#pragma once
+
+/* Pieces of the packer and unpacker shared between the file level
+   functions and the framed format. Not part of the library interface. */
+
+#include "common.h"
+#include "kernels.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HEADER_SIZE        10   /* "LZW\0", version, infoBits, inputSize */
+#define FRAME_HEADER_SIZE  8    /* rawSize, packedSize */
+
+/* worst case packed frame record for len input bytes */
+#define FRAME_BOUND(len)   (FRAME_HEADER_SIZE + PACKED_SIZE(MAX_CODES(len)))
+
+struct lzwHeader
+{
+  uint8_t version;
+  uint8_t infoBits;
+  uint32_t inputSize;
+};
+
+/* SPARSE_OUTPUT leaves holes for all-zero blocks of this size */
+#define SPARSE_BLOCK       4096
+
+int IsZero (const uint8_t *p, size_t len);
+
+void put_u32 (uint8_t *p, uint32_t v);
+uint32_t get_u32 (const uint8_t *p);
+
+uint8_t InfoBits (void);
+int WriteHeader (FILE *fp, uint8_t version, uint32_t inputSize);
+int ReadHeader (FILE *fp, struct lzwHeader *hdr);
+int ParseHeader (const uint8_t *header, size_t len, struct lzwHeader *hdr);
+
+/*--------------------------------------------------------------------*/
+/* Progress and cancellation (progress.c)                             */
+/*--------------------------------------------------------------------*/
+
+struct progressState
+{
+  const struct lzwOptions *options;   /* NULL: nothing to report */
+  unsigned long bytesIn, bytesOut, total;
+  unsigned long interval, nextReport, lastRaw;
+  double start, last;
+  int decoding;
+};
+
+void InitProgress (struct progressState *ps, const struct lzwOptions *options,
+                   unsigned long total, int decoding);
+
+/* Records running totals and calls the callback when due. Returns 0 if
+   the job has been cancelled. */
+int UpdateProgress (struct progressState *ps, unsigned long bytesIn, unsigned long bytesOut);
+void FinishProgress (struct progressState *ps);
+
+/* monotonic wall clock where available */
+double WallSeconds (void);
+
+/*--------------------------------------------------------------------*/
+/* Dictionary reset policies (policy.c)                               */
+/*--------------------------------------------------------------------*/
+
+#define RESET_WINDOW    4096   /* input bytes between checks; divides BUFFLEN */
+#define RECENT_WINDOWS  2
+
+struct resetMonitor
+{
+  int policy;                            /* LZW_RESET_... */
+  unsigned long bytes, codes;            /* current window */
+  unsigned long sinceBytes, sinceCodes;  /* since the last reset */
+  unsigned long recentBytes[RECENT_WINDOWS], recentCodes[RECENT_WINDOWS];
+  int recentCount;
+  double best;                           /* best ratio since the last reset, 0 if none */
+  double fill;                           /* ratio while the dictionary filled up, 0 if not yet */
+  struct lzwResetStats stats;
+};
+
+void InitResetMonitor (struct resetMonitor *m, int policy);
+
+/* counts bytes of input packed into codes; full if the dictionary was */
+void MonitorBlock (struct resetMonitor *m, unsigned long bytes, unsigned long codes, int full);
+
+/* At the end of a window: returns 1 if HT_CLEAR_CODE is to be written
+   now, which the monitor then counts. */
+int WantReset (struct resetMonitor *m, int full);
+
+/* counts a clear made by the encoder when the dictionary filled up */
+void MonitorClear (struct resetMonitor *m);
+
+/*--------------------------------------------------------------------*/
+/* Deduplication (dedup.c)                                            */
+/*--------------------------------------------------------------------*/
+
+/* DEDUP_VERSION frames are chunks of CHUNK_MIN to CHUNK_MAX bytes. A
+   repeated one is a reference frame: packedSize REFERENCE_FRAME and a
+   4 byte payload, the offset of an earlier copy in the unpacked data. */
+#define CHUNK_MIN        16384
+#define CHUNK_MAX        FRAME_SIZE
+#define CHUNK_BITS       15        /* about 2^CHUNK_BITS bytes past CHUNK_MIN on average */
+#define REFERENCE_FRAME  0xFFFFFFFFUL
+#define REFERENCE_SIZE   4
+
+struct chunkEntry
+{
+  uint64_t hash;
+  uint32_t offset;   /* in the input */
+  uint32_t size;
+};
+
+struct chunkIndex
+{
+  uint64_t gear[256];
+  struct chunkEntry *slots;
+  size_t capacity, used;
+};
+
+int InitChunkIndex (struct chunkIndex *idx);
+void FreeChunkIndex (struct chunkIndex *idx);
+
+/* Length of the chunk starting at p, of the len bytes there; 0 if that
+   needs more data, unless last. */
+size_t NextChunk (const struct chunkIndex *idx, const uint8_t *p, size_t len, int last);
+
+uint64_t ChunkHash (const uint8_t *p, size_t len);
+
+/* first chunk added with this fingerprint and size, or NULL */
+const struct chunkEntry *FindChunk (const struct chunkIndex *idx, uint64_t hash, uint32_t size);
+int AddChunk (struct chunkIndex *idx, uint64_t hash, uint32_t offset, uint32_t size);
+
+/*--------------------------------------------------------------------*/
+/* Encoder side (lzw06pack.c)                                         */
+/*--------------------------------------------------------------------*/
+
+int InitEncodeState (struct encodeState *es, int flags);
+void ResetEncodeState (struct encodeState *es);
+void FreeEncodeState (struct encodeState *es);
+
+/* Encodes len bytes as one self-contained frame record into out, which
+   must hold FRAME_BOUND(len) bytes; codes must hold MAX_CODES(len).
+   FAST_MODE in flags selects the single-probe dictionary. Returns size
+   of the record. */
+size_t EncodeFrame (const struct lzwKernels *k, struct encodeState *es, int flags,
+                    const uint8_t *in, size_t len, uint16_t *codes, uint8_t *out);
+
+/* CompressBuffer without the file header: just the frame records
+   (lzw06mem.c). */
+int CompressFrames (struct lzwContext *ctx, const void *in, size_t size,
+                    void *out, size_t capacity, size_t *outSize);
+
+/*--------------------------------------------------------------------*/
+/* Decoder side (lzw06unpack.c)                                       */
+/*--------------------------------------------------------------------*/
+
+struct unpackHelper
+{
+  uint16_t prefix [HT_MAX_CODE];
+  uint16_t suffix [HT_MAX_CODE];
+  uint16_t stack [HT_MAX_CODE];
+  int16_t RunCode;
+  int16_t OldCode;
+};
+
+void ResetUnpackHelper (struct unpackHelper *uh);
+
+/* Expands one data code (not HT_CLEAR_CODE/EOF_CODE) into out. Returns
+   number of bytes written, or -1 if the code is invalid or its string is
+   longer than avail. */
+int ExpandCode (struct unpackHelper *uh, uint16_t code, uint8_t *out, size_t avail);
+
+/* Decodes packed codes up to EOF_CODE, which must expand to exactly
+   rawSize bytes. phraseBlock is BUFFLEN for a version 0 stream, where no
+   phrase crosses those boundaries, and 0 otherwise. codes must hold
+   UNPACKED_COUNT(len). Returns 1 on success. */
+int DecodeCodes (const struct lzwKernels *k, struct unpackHelper *uh,
+                 const uint8_t *packed, size_t len, uint16_t *codes,
+                 uint8_t *out, size_t rawSize, size_t phraseBlock);
+
+/* Expands the count codes between two dictionary resets (no
+   HT_CLEAR_CODE or EOF_CODE) into exactly rawSize bytes. offset is the
+   stream position of out, which places the phraseBlock boundaries.
+   Returns 1 on success. */
+int ExpandSegment (struct unpackHelper *uh, const uint16_t *codes, size_t count,
+                   uint8_t *out, size_t rawSize, unsigned long offset, size_t phraseBlock);
@@ -1,4 +1,7 @@
+#define _GNU_SOURCE /* fileno, ftruncate */
+
 #include "common.h"
+#include "codec.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -45,6 +48,31 @@ int file_exists (const char *filename)
 
 /*--------------------------------------------------------------------*/
 
+int truncate_file (FILE *fp, long size)
+{
+  fflush (fp);
+#if defined(__linux__)
+  return (ftruncate(fileno(fp), size) == 0) ? 1 : 0;
+#elif defined(_WIN32)
+  return (_chsize(_fileno(fp), size) == 0) ? 1 : 0;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+/* fflush, then wait until the data is on disk */
+int sync_file (FILE *fp)
+{
+  if (0 != fflush (fp))
+    return 0;
+#if defined(__linux__)
+  return (fsync(fileno(fp)) == 0) ? 1 : 0;
+#elif defined(_WIN32)
+  return (_commit(_fileno(fp)) == 0) ? 1 : 0;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
 char *str_dup (const char *s) /* strdup replacement. */
 {
   size_t size = strlen (s) + 1;
@@ -56,3 +84,93 @@ char *str_dup (const char *s) /* strdup replacement. */
   return ret;
 }
 
+
+/*--------------------------------------------------------------------*/
+
+int IsZero (const uint8_t *p, size_t len)
+{
+  return len == 0 || (p[0] == 0 && memcmp (p, p + 1, len - 1) == 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+void put_u32 (uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+uint32_t get_u32 (const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*--------------------------------------------------------------------*/
+
+uint8_t InfoBits (void)
+{
+  uint8_t infoBits = 0;
+
+  infoBits |= (is_big_endian() ? 1 : 0);
+  infoBits |= VARIABLE_WIDTH ? 2 : 0;
+
+  /* leaving 2 bits reserved. */
+  infoBits |= ((MAX_BITS - 8) << 4); /* we use left 4 bits for MAX_BITS information; can be between 8 and 23. */
+
+  return infoBits;
+}
+
+/*--------------------------------------------------------------------*/
+
+int WriteHeader (FILE *fp, uint8_t version, uint32_t inputSize)
+{
+  uint8_t header[HEADER_SIZE] = { 'L', 'Z', 'W', 0 };
+
+  header[4] = version;
+  header[5] = InfoBits ();
+  put_u32 (header + 6, inputSize);
+
+  return (HEADER_SIZE == fwrite (header, 1, HEADER_SIZE, fp)) ? 1 : 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int ReadHeader (FILE *fp, struct lzwHeader *hdr)
+{
+  uint8_t header[HEADER_SIZE];
+  size_t len = fread (header, 1, HEADER_SIZE, fp);
+
+  return ParseHeader (header, len, hdr);
+}
+
+/*--------------------------------------------------------------------*/
+
+int ParseHeader (const uint8_t *header, size_t len, struct lzwHeader *hdr)
+{
+  if (len < HEADER_SIZE || memcmp (header, "LZW", 3) != 0)
+  {
+    printf("Not an LZW file!\n");
+    return 0;
+  }
+
+  hdr->version = header[4];
+  hdr->infoBits = header[5];
+  hdr->inputSize = get_u32 (header + 6);
+
+  if (hdr->version != PACKER_VERSION && hdr->version != FRAMED_VERSION
+      && hdr->version != CONTINUOUS_VERSION && hdr->version != DEDUP_VERSION)
+  {
+    fprintf(stderr, "Packer/unpacker version mismatch.\n");
+    return 0;
+  }
+
+  if (hdr->infoBits != InfoBits ())
+  {
+    fprintf(stderr, "Encoding flags mismatch.\n");
+    return 0;
+  }
+
+  return 1;
+}
@@ -6,7 +6,12 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+#include <stdio.h>
+
 #define PACKER_VERSION  0
+#define FRAMED_VERSION  1       /* independent frames, see lzw06pack.c */
+#define CONTINUOUS_VERSION 2    /* version 0 without the phrase break every BUFFLEN bytes */
+#define DEDUP_VERSION   3       /* framed, cut by content; repeated frames refer back (dedup.c) */
 #define VARIABLE_WIDTH  0
 #define MAX_BITS        12
 
@@ -15,12 +20,19 @@
 #define true  1
 #define false 0
 
-#define BUFFLEN         16384    /* the larger, the better for compression */
+#define BUFFLEN         16384    /* version 0 phrase block; fixed by the format */
+#define IO_BUFFLEN      (1L << 20)  /* default read size of the stream formats */
 #define OUTLEN          3078     /* must be divisible by 3 because of 12-bit per code; does not affect compression. */
+#define FRAME_SIZE      262144   /* input bytes per frame in framed output */
 
 enum { HT_SIZE = 8192, HT_KEY_MASK = 8191, HT_CLEAR_CODE = 4094, EOF_CODE = 4095, HT_MAX_CODE = 4096 };
 
+/* FAST_MODE direct-mapped table; larger than HT_SIZE to keep collisions down */
+enum { FAST_HT_BITS = 15, FAST_HT_SIZE = 1 << FAST_HT_BITS };
+
 int is_big_endian(void);
 void cleanup (const char *outfile, int flags);
 int file_exists (const char *filename);
+int truncate_file (FILE *fp, long size);
+int sync_file (FILE *fp);
 char *str_dup (const char *s);
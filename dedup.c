@@ -0,0 +1,147 @@
+/* Content-defined chunking and the chunk index of DEDUP_OUTPUT. Chunk
+   boundaries come from a gear rolling hash over the data, so an insert
+   or a shift only moves the boundaries near it and the same data cuts
+   into the same chunks wherever it sits in the input. */
+
+#include "codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_MASK  ((((uint64_t)1 << CHUNK_BITS) - 1) << (64 - CHUNK_BITS))
+#define EMPTY_SLOT  0   /* chunkEntry.size of an unused slot */
+
+/*--------------------------------------------------------------------*/
+/* splitmix64: the same gear table on every run */
+static uint64_t NextRandom (uint64_t *state)
+{
+  uint64_t z = (*state += 0x9E3779B97F4A7C15UL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+
+  return z ^ (z >> 31);
+}
+
+/*--------------------------------------------------------------------*/
+
+int InitChunkIndex (struct chunkIndex *idx)
+{
+  uint64_t state = 0;
+  int i;
+
+  for (i = 0; i < 256; i++)
+    idx->gear[i] = NextRandom (&state);
+
+  idx->capacity = 4096;
+  idx->used = 0;
+  idx->slots = (struct chunkEntry *)calloc(idx->capacity, sizeof(struct chunkEntry));
+
+  return idx->slots != NULL;
+}
+
+void FreeChunkIndex (struct chunkIndex *idx)
+{
+  free (idx->slots);
+  idx->slots = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t NextChunk (const struct chunkIndex *idx, const uint8_t *p, size_t len, int last)
+{
+  size_t i, n = (len < CHUNK_MAX) ? len : CHUNK_MAX;
+  uint64_t h = 0;
+
+  /* the hash only looks at the last 64 bytes; the minimum is skipped */
+  for (i = CHUNK_MIN; i < n; i++)
+  {
+    h = (h << 1) + idx->gear[p[i]];
+
+    if (!(h & CHUNK_MASK))
+      return i + 1;
+  }
+
+  if (n == CHUNK_MAX)
+    return CHUNK_MAX;
+
+  return last ? len : 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* 64-bit fingerprint; a match is only a candidate, checked by the caller */
+uint64_t ChunkHash (const uint8_t *p, size_t len)
+{
+  uint64_t h = len, w;
+  size_t i = 0;
+
+  for (; i + 8 <= len; i += 8)
+  {
+    memcpy (&w, p + i, 8);
+    h = ((h << 31 | h >> 33) ^ w) * 0x9E3779B97F4A7C15UL;
+  }
+
+  for (w = 0; i < len; i++)
+    w = (w << 8) | p[i];
+
+  h = ((h << 31 | h >> 33) ^ w) * 0x9E3779B97F4A7C15UL;
+
+  return h ^ (h >> 29);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct chunkEntry *Slot (const struct chunkIndex *idx, uint64_t hash, uint32_t size)
+{
+  size_t i = (size_t)hash & (idx->capacity - 1);
+
+  while (idx->slots[i].size != EMPTY_SLOT &&
+         (idx->slots[i].hash != hash || idx->slots[i].size != size))
+    i = (i + 1) & (idx->capacity - 1);
+
+  return idx->slots + i;
+}
+
+const struct chunkEntry *FindChunk (const struct chunkIndex *idx, uint64_t hash, uint32_t size)
+{
+  const struct chunkEntry *e = Slot (idx, hash, size);
+
+  return (e->size == EMPTY_SLOT) ? NULL : e;
+}
+
+/*--------------------------------------------------------------------*/
+/* kept at most half full */
+int AddChunk (struct chunkIndex *idx, uint64_t hash, uint32_t offset, uint32_t size)
+{
+  struct chunkEntry *old = idx->slots, *e;
+  size_t i, capacity = idx->capacity;
+
+  if (2 * (idx->used + 1) > idx->capacity)
+  {
+    if (NULL == (idx->slots = (struct chunkEntry *)calloc(2 * capacity, sizeof(struct chunkEntry))))
+    {
+      idx->slots = old;
+      return 0;
+    }
+
+    idx->capacity = 2 * capacity;
+
+    for (i = 0; i < capacity; i++)
+      if (old[i].size != EMPTY_SLOT)
+        *Slot (idx, old[i].hash, old[i].size) = old[i];
+
+    free (old);
+  }
+
+  e = Slot (idx, hash, size);
+
+  if (e->size == EMPTY_SLOT)
+  {
+    e->hash = hash;
+    e->offset = offset;
+    e->size = size;
+    idx->used++;
+  }
+
+  return 1;
+}
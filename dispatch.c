@@ -0,0 +1,90 @@
+/* Runtime selection of the kernels.c build to use. */
+
+#include "kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern const struct lzwKernels lzw_kernels_baseline;
+
+#if defined(LZW06_MULTI_ISA)
+extern const struct lzwKernels lzw_kernels_sse42;
+extern const struct lzwKernels lzw_kernels_avx2;
+#endif
+
+static const struct lzwKernels *selected = NULL;
+
+/*--------------------------------------------------------------------*/
+/* LZW06_ISA values are the kernel names */
+static int KnownLevel (const char *name)
+{
+  return 0 == strcmp (name, "baseline") || 0 == strcmp (name, "sse42") || 0 == strcmp (name, "avx2");
+}
+
+/*--------------------------------------------------------------------*/
+
+static const struct lzwKernels *SelectKernels (void)
+{
+  const struct lzwKernels *best = &lzw_kernels_baseline;
+  const char *forced = getenv ("LZW06_ISA");
+
+#if defined(LZW06_MULTI_ISA)
+  int has_sse42, has_avx2;
+
+  __builtin_cpu_init ();
+
+  has_sse42 = __builtin_cpu_supports ("sse4.2");
+  has_avx2 = __builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("bmi2");
+
+  if (has_avx2) best = &lzw_kernels_avx2;
+  else if (has_sse42) best = &lzw_kernels_sse42;
+
+  if (forced != NULL && *forced != '\0')
+  {
+    if (0 == strcmp (forced, lzw_kernels_baseline.name))
+      return &lzw_kernels_baseline;
+
+    if (0 == strcmp (forced, lzw_kernels_sse42.name) && has_sse42)
+      return &lzw_kernels_sse42;
+
+    if (0 == strcmp (forced, lzw_kernels_avx2.name) && has_avx2)
+      return &lzw_kernels_avx2;
+
+    if (KnownLevel (forced))
+      fprintf (stderr, "LZW06_ISA=%s not supported on this CPU, using %s.\n", forced, best->name);
+    else
+      fprintf (stderr, "Unknown LZW06_ISA=%s (baseline, sse42 or avx2), using %s.\n", forced, best->name);
+  }
+#else
+  if (forced != NULL && *forced != '\0' && 0 != strcmp (forced, lzw_kernels_baseline.name))
+  {
+    if (KnownLevel (forced))
+      fprintf (stderr, "LZW06_ISA=%s not available in this build, using %s.\n", forced, best->name);
+    else
+      fprintf (stderr, "Unknown LZW06_ISA=%s (baseline, sse42 or avx2), using %s.\n", forced, best->name);
+  }
+#endif
+
+  return best;
+}
+
+/*--------------------------------------------------------------------*/
+
+const struct lzwKernels *GetKernels (void)
+{
+  if (selected == NULL)
+  {
+    selected = SelectKernels ();
+  }
+
+  return selected;
+}
+
+#if defined(__GNUC__)
+/* pick kernels at load time so the first Compress call does not pay for it */
+static void __attribute__((constructor)) InitKernels (void)
+{
+  GetKernels ();
+}
+#endif
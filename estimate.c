@@ -0,0 +1,282 @@
+/* Compression ratio estimate from sampled blocks. Each sample runs the
+   packer's own dictionary code from an empty dictionary, which is also
+   the state after every HT_CLEAR_CODE, and only whole dictionary cycles
+   are counted, so the samples see the dictionary as the file would.
+   Samples are spread over the input and taken until the estimate
+   settles or the budget is spent. */
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define SAMPLE_SIZE     (4 * BUFFLEN)   /* input bytes per sample */
+#define SAMPLE_STEP     64              /* resolution of the dictionary cycle ends */
+#define DEFAULT_BUDGET  (16 * SAMPLE_SIZE)
+#define MIN_SAMPLES     4
+#define SETTLED_ERROR   0.005           /* standard error of the mean ratio to stop at */
+
+/* small inputs are packed whole */
+#define PACK_WHOLE(size, budget)  ((size) <= (budget) || (size) < 2 * SAMPLE_SIZE)
+
+struct sampler
+{
+  encodeBlockFn encode_block;
+  struct encodeState es;
+  uint16_t *codes;
+
+  /* input: a buffer, or a file read one sample at a time */
+  const uint8_t *data;
+  FILE *fp;
+  uint8_t *buffer;
+  size_t size;
+};
+
+/*--------------------------------------------------------------------*/
+/* Codes for len bytes in the version 0 layout: a new phrase every
+   BUFFLEN block, closed at its end. */
+static size_t CountCodes (struct sampler *s, const uint8_t *in, size_t len)
+{
+  size_t count = 0, block;
+
+  while (len > 0)
+  {
+    block = (len < BUFFLEN) ? len : BUFFLEN;
+
+    s->es.CurCode = NO_PHRASE;
+    count += s->encode_block (&s->es, in, block, s->codes) + 1;
+
+    in += block;
+    len -= block;
+  }
+
+  return count;
+}
+
+/*--------------------------------------------------------------------*/
+/* Same as CountCodes from an empty dictionary, but only up to the last
+   dictionary reset, give or take SAMPLE_STEP bytes. *used gets the input
+   bytes covered; all of len if the dictionary never filled. */
+static size_t CountCycles (struct sampler *s, const uint8_t *in, size_t len, size_t *used)
+{
+  size_t pos, step, count = 0, cycles = 0, k, n;
+
+  ResetEncodeState (&s->es);
+  *used = len;
+
+  for (pos = 0; pos < len; pos += step)
+  {
+    step = (len - pos < SAMPLE_STEP) ? len - pos : SAMPLE_STEP;
+
+    if (pos % BUFFLEN == 0)
+    {
+      count += (pos > 0);   /* closes the previous block */
+      s->es.CurCode = NO_PHRASE;
+    }
+
+    n = s->encode_block (&s->es, in + pos, step, s->codes);
+
+    for (k = n; k > 0; k--)
+    {
+      if (s->codes[k - 1] == HT_CLEAR_CODE)
+      {
+        cycles = count + k;
+        *used = pos + step;
+        break;
+      }
+    }
+
+    count += n;
+  }
+
+  return cycles ? cycles : count + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static const uint8_t *ReadSample (struct sampler *s, size_t offset, size_t len)
+{
+  if (s->fp == NULL)
+    return s->data + offset;
+
+  if (0 != fseek (s->fp, (long)offset, SEEK_SET) || len != fread (s->buffer, 1, len, s->fp))
+    return NULL;
+
+  return s->buffer;
+}
+
+/*--------------------------------------------------------------------*/
+/* bits low bits of i in reverse order */
+static size_t Reverse (size_t i, int bits)
+{
+  size_t r = 0;
+
+  while (bits-- > 0)
+  {
+    r = (r << 1) | (i & 1);
+    i >>= 1;
+  }
+
+  return r;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Estimate (struct sampler *s, size_t budget, double *ratio)
+{
+  const uint8_t *in;
+  size_t slots, i, slot, taken = 0, count, used;
+  double r, sum = 0, sumSq = 0, variance;
+  int bits = 0;
+
+  if (PACK_WHOLE(s->size, budget))
+  {
+    if (NULL == (in = ReadSample (s, 0, s->size)))
+      return 0;
+
+    count = CountCodes (s, in, s->size) + 1;  /* EOF_CODE */
+    *ratio = (s->size > 0) ? (double)(HEADER_SIZE + PACKED_SIZE(count)) / s->size : 1.0;
+
+    return 1;
+  }
+
+  slots = s->size / SAMPLE_SIZE;
+
+  if (slots > budget / SAMPLE_SIZE)
+    slots = budget / SAMPLE_SIZE;
+
+  if (slots < MIN_SAMPLES)
+    slots = MIN_SAMPLES;
+
+  while (((size_t)1 << bits) < slots)
+    bits++;
+
+  /* bit reversed order: the first samples already cover the whole input */
+  for (i = 0; i < ((size_t)1 << bits); i++)
+  {
+    if ((slot = Reverse (i, bits)) >= slots)
+      continue;
+
+    if (NULL == (in = ReadSample (s, slot * ((s->size - SAMPLE_SIZE) / (slots - 1)), SAMPLE_SIZE)))
+      return 0;
+
+    count = CountCycles (s, in, SAMPLE_SIZE, &used);
+    r = (double)PACKED_SIZE(count) / used;
+
+    sum += r;
+    sumSq += r * r;
+    taken++;
+
+    if (taken >= MIN_SAMPLES)
+    {
+      variance = (sumSq - sum * sum / taken) / (taken - 1);
+
+      if (variance <= 0 || sqrt (variance / taken) < SETTLED_ERROR)
+        break;
+    }
+  }
+
+  /* every sample stands for the same share of the input */
+  *ratio = sum / taken + (double)HEADER_SIZE / s->size;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int InitSampler (struct sampler *s, int flags)
+{
+  const struct lzwKernels *k = GetKernels ();
+
+  memset (s, 0, sizeof(*s));
+  s->encode_block = (flags & FAST_MODE) ? k->encode_block_fast : k->encode_block;
+  s->codes = (uint16_t *)malloc(MAX_CODES(BUFFLEN) * sizeof(uint16_t));
+
+  if (s->codes == NULL)
+    return 0;
+
+  if (!InitEncodeState (&s->es, flags))
+  {
+    free (s->codes);
+    return 0;
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void FreeSampler (struct sampler *s)
+{
+  FreeEncodeState (&s->es);
+  free (s->codes);
+  free (s->buffer);
+}
+
+/*--------------------------------------------------------------------*/
+
+int EstimateRatio (const void *in, size_t size, size_t budget, int flags, double *ratio)
+{
+  struct sampler s;
+  int ok;
+
+  if (!InitSampler (&s, flags))
+    return 0;
+
+  s.data = (const uint8_t *)in;
+  s.size = size;
+
+  ok = Estimate (&s, budget ? budget : DEFAULT_BUDGET, ratio);
+
+  FreeSampler (&s);
+  return ok;
+}
+
+/*--------------------------------------------------------------------*/
+
+int EstimateFileRatio (const char *filename, size_t budget, int flags, double *ratio)
+{
+  struct sampler s;
+  long size;
+  int ok;
+
+  if (!InitSampler (&s, flags))
+  {
+    perror (NULL);
+    return 0;
+  }
+
+  s.fp = fopen (filename, "rb");
+
+  if (s.fp == NULL)
+  {
+    fprintf (stderr, "Cannot open input file \'%s\'.\n", filename);
+    perror (NULL);
+    FreeSampler (&s);
+    return 0;
+  }
+
+  fseek (s.fp, 0, SEEK_END);
+  size = ftell (s.fp);
+
+  s.size = (size > 0) ? (size_t)size : 0;
+
+  if (budget == 0)
+    budget = DEFAULT_BUDGET;
+
+  s.buffer = (uint8_t *)malloc(PACK_WHOLE(s.size, budget) ? s.size + 1 : SAMPLE_SIZE);
+
+  if (size < 0 || s.buffer == NULL || !(ok = Estimate (&s, budget, ratio)))
+  {
+    fprintf (stderr, "Cannot read input file \'%s\'.\n", filename);
+    ok = 0;
+  }
+
+  fclose (s.fp);
+  FreeSampler (&s);
+
+  return ok;
+}
@@ -1,6 +1,11 @@
 #pragma once
 
-enum { KEEP_ON_ERROR = 1, VERBOSE_OUTPUT = 2, OVERWRITE_FLAG = 4 };
+#include <stddef.h>
+#include <signal.h>
+
+enum { KEEP_ON_ERROR = 1, VERBOSE_OUTPUT = 2, OVERWRITE_FLAG = 4, BLOCKED_OUTPUT = 8, FAST_MODE = 16,
+       CONTINUOUS_OUTPUT = 32, SPARSE_OUTPUT = 64, RESUMABLE_OUTPUT = 128,
+       DEDUP_OUTPUT = 256 };
 
 #ifdef __cplusplus
 extern "C"
@@ -11,6 +16,168 @@ extern "C"
 extern int Decompress (const char *, const char *, int flags);
 extern int Compress (const char *, const char *, int flags);
 
+/* Progress of a CompressEx/DecompressEx job. mbPerSec is the rate of
+   uncompressed data since the previous call; total is the uncompressed
+   size of the job. */
+struct lzwProgress
+{
+  unsigned long bytesIn;
+  unsigned long bytesOut;
+  unsigned long total;
+  double seconds;
+  double mbPerSec;
+};
+
+typedef void (*lzwProgressFn) (const struct lzwProgress *progress, void *user);
+
+/* Dictionary reset policy of the stream formats (lzwOptions.resetPolicy;
+   framed files always reset at a full dictionary). LZW_RESET_FULL clears
+   the dictionary when it fills up. The others keep using a full
+   dictionary and check the codes/input ratio every 4 Kb of input:
+   LZW_RESET_RATIO clears it once the ratio since the last reset stops
+   improving, as Unix compress does; LZW_RESET_WINDOW once the ratio of
+   the last 8 Kb is not clearly better than the one the dictionary had
+   while filling up, or, before it is full, when the data changes. These
+   two need CONTINUOUS_OUTPUT: version 0 readers that predate it do not
+   expect codes after a full dictionary. */
+enum { LZW_RESET_FULL = 0, LZW_RESET_RATIO = 1, LZW_RESET_WINDOW = 2 };
+
+struct lzwResetStats
+{
+  unsigned long resets;        /* HT_CLEAR_CODE written */
+  unsigned long earlyResets;   /* of those, with the dictionary not yet full */
+  unsigned long frozenBytes;   /* input packed with a full dictionary */
+};
+
+struct lzwOptions
+{
+  int flags;
+  lzwProgressFn progress;    /* may be NULL; also called once at the end */
+  void *user;
+  unsigned long interval;    /* uncompressed bytes between calls, 0 for 1 MB */
+  volatile sig_atomic_t *cancel;  /* may be NULL; set non-zero to stop the job */
+  unsigned long bufferSize;  /* bytes per read/write, 0 for the default; does not change the output */
+  unsigned long checkpointInterval;  /* RESUMABLE_OUTPUT: input bytes between checkpoints, 0 for 64 MB */
+  int resetPolicy;           /* LZW_RESET_... */
+  struct lzwResetStats *resetStats;  /* may be NULL; filled in by CompressEx */
+};
+
+/* Same as Compress/Decompress. The cancel flag is checked between
+   buffers; a cancelled job fails, and its output is removed unless
+   KEEP_ON_ERROR is set.
+   With RESUMABLE_OUTPUT, CompressEx saves a checkpoint (outputFile.ckpt)
+   at a dictionary reset every checkpointInterval input bytes and, once
+   one is saved, keeps the output on failure; a later run with the same input, output and
+   flags continues from the last checkpoint and gives the same file as
+   an uninterrupted run. The checkpoint is removed on success. */
+extern int DecompressEx (const char *, const char *, const struct lzwOptions *options);
+extern int CompressEx (const char *, const char *, const struct lzwOptions *options);
+
+/* Compresses the file into new frames at the end of an existing framed
+   (BLOCKED_OUTPUT) file and updates its header, so the cost only depends
+   on the new data. Creates a framed file if the target does not exist.
+   On failure the target keeps its old contents. */
+extern int Append (const char *, const char *, int flags);
+extern int AppendEx (const char *, const char *, const struct lzwOptions *options);
+
+/* Same as Decompress, on several threads: a version 0 or 2 file is split
+   at its dictionary resets and the pieces are unpacked side by side.
+   Framed files are unpacked as by Decompress. threads <= 0 uses one per
+   CPU. Linux only; elsewhere this is Decompress.
+   DecompressParallelEx takes the options of DecompressEx; progress and
+   the cancel flag are checked after each piece. */
+extern int DecompressParallel (const char *, const char *, int flags, int threads);
+extern int DecompressParallelEx (const char *, const char *, const struct lzwOptions *options,
+                                 int threads);
+
+/* In-memory interface. A context owns all codec state, so calls on it do
+   not allocate (except to grow decoder scratch space). Use one context
+   per thread. FAST_MODE, BLOCKED_OUTPUT and CONTINUOUS_OUTPUT apply and
+   are fixed when the context is created; CompressBuffer then produces the same bytes as
+   Compress. DecompressBuffer reads both layouts. */
+struct lzwContext;
+
+extern struct lzwContext *CreateContext (int flags);
+extern void FreeContext (struct lzwContext *ctx);
+
+extern size_t CompressBound (size_t size);
+extern int CompressBuffer (struct lzwContext *ctx, const void *in, size_t size,
+                           void *out, size_t capacity, size_t *outSize);
+extern int DecompressBuffer (struct lzwContext *ctx, const void *in, size_t size,
+                             void *out, size_t capacity, size_t *outSize);
+
+/* Incremental compression for many streams alive at once, such as one
+   per connection. An encoder stream turns its input, given in pieces of
+   any size, into the codes of a CONTINUOUS_OUTPUT file: behind a header
+   for the total size, StreamCompress output followed by StreamFinish
+   output is what Compress writes. FAST_MODE applies. StreamCompress
+   needs StreamBound(size) bytes of out, StreamFinish StreamBound(0);
+   the stream then starts over.
+   A decoder stream reads such codes in pieces of any size. It stops
+   early when out is full, with *used telling how much of in it took;
+   out should have room for 4096 bytes, the longest string. StreamEnded
+   is 1 once EOF_CODE was read.
+   A stream holds no tables until it gets data. HibernateStream frees
+   them, keeping the dictionary in 2.5 bytes per string (at most 10 Kb);
+   the next call rebuilds them. StreamMemory is what the stream holds
+   now. Use a stream on one thread at a time. */
+struct lzwStream;
+
+extern struct lzwStream *CreateEncoderStream (int flags);
+extern struct lzwStream *CreateDecoderStream (void);
+extern void FreeStream (struct lzwStream *s);
+
+extern size_t StreamBound (size_t size);
+extern int StreamCompress (struct lzwStream *s, const void *in, size_t size,
+                           void *out, size_t capacity, size_t *outSize);
+extern int StreamFinish (struct lzwStream *s, void *out, size_t capacity, size_t *outSize);
+
+extern int StreamDecompress (struct lzwStream *s, const void *in, size_t size, size_t *used,
+                             void *out, size_t capacity, size_t *outSize);
+extern int StreamEnded (const struct lzwStream *s);
+
+extern int HibernateStream (struct lzwStream *s);
+extern size_t StreamMemory (const struct lzwStream *s);
+
+/* original size recorded in a compressed image */
+extern int DecompressedSize (const void *in, size_t size, size_t *outSize);
+
+/* Predicts the size of the Compress output divided by size, by packing
+   sampled blocks of the input with the same dictionary (FAST_MODE in
+   flags applies). At most budget input bytes are sampled, 0 for 1 MB;
+   smaller inputs are packed whole and the ratio is exact. Sampling
+   stops early once the estimate settles. */
+extern int EstimateRatio (const void *in, size_t size, size_t budget, int flags, double *ratio);
+extern int EstimateFileRatio (const char *filename, size_t budget, int flags, double *ratio);
+
+/* Finds every occurrence of pattern (1 to LZW_MAX_PATTERN bytes) in the
+   uncompressed data of a compressed file or image, working on the codes
+   without rebuilding the data. hit, if not NULL, gets the offset of each
+   match in increasing order (overlapping matches included); count gets
+   the number of matches. */
+#define LZW_MAX_PATTERN 64
+
+typedef void (*lzwHitFn) (unsigned long offset, void *user);
+
+extern int SearchFile (const char *filename, const void *pattern, size_t len,
+                       lzwHitFn hit, void *user, unsigned long *count);
+extern int SearchBuffer (const void *in, size_t size, const void *pattern, size_t len,
+                         lzwHitFn hit, void *user, unsigned long *count);
+
+/* Random access to a framed (BLOCKED_OUTPUT) file. ReaderRead works
+   like pread on the uncompressed data: it returns the bytes copied, 0
+   at the end, or -1 on error. Frames are decoded on demand and the last
+   cacheBlocks (0 for 16) are kept, least recently used going first.
+   A reader can be shared by threads; hits and misses count frame
+   lookups. Linux only. */
+struct lzwReader;
+
+extern struct lzwReader *OpenReader (const char *filename, size_t cacheBlocks);
+extern void CloseReader (struct lzwReader *r);
+extern long ReaderRead (struct lzwReader *r, void *buf, size_t len, unsigned long offset);
+extern unsigned long ReaderSize (const struct lzwReader *r);
+extern void ReaderStats (struct lzwReader *r, unsigned long *hits, unsigned long *misses);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,265 @@
+/* Packer/unpacker kernels. This file is compiled several times with
+   different -m flags and KERNEL_SUFFIX (see Makefile); the intrinsic
+   paths below are enabled by whatever the compiler flags allow. */
+
+#include "common.h"
+#include "kernels.h"
+
+#include <string.h>
+
+#if defined(__SSE4_1__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#ifndef KERNEL_SUFFIX
+#define KERNEL_SUFFIX baseline
+#endif
+
+#define KERNEL_CAT2(a, b)  a##_##b
+#define KERNEL_CAT(a, b)   KERNEL_CAT2(a, b)
+#define KERNEL(name)       KERNEL_CAT(name, KERNEL_SUFFIX)
+
+#define KERNEL_STR2(a)     #a
+#define KERNEL_STR(a)      KERNEL_STR2(a)
+
+#if defined(__GNUC__)
+#define FORCE_INLINE       __inline__ __attribute__((always_inline))
+#else
+#define FORCE_INLINE
+#endif
+
+/* Dictionary lookups. The encoder loop below is written once and
+   instantiated per dictionary with these inlined into them. */
+typedef int (*existFn) (const uint32_t Key, const uint32_t *table);
+typedef void (*insertFn) (const uint32_t Key, int Code, uint32_t *table);
+
+/*------------------------------------*/
+static int KeyItem (const uint32_t Item)
+{
+  return ((Item >> 12) ^ Item) & HT_KEY_MASK;
+}
+/*-------------------------------------*/
+static void InsertHashTable (const uint32_t Key, int Code, uint32_t *table)
+{
+  int HKey = KeyItem(Key);
+
+  while (HT_GET_KEY(table[HKey]) != HT_EMPTY_KEY)
+    HKey = (HKey + 1) & HT_KEY_MASK;
+
+  table[HKey] = HT_PUT_KEY(Key) | HT_PUT_CODE(Code);
+}
+/*--------------------------------------------*/
+static int ExistHashTable (const uint32_t Key, const uint32_t *table)
+{
+  int HKey = KeyItem(Key);
+  uint32_t HTKey;
+
+  while ((HTKey = HT_GET_KEY(table[HKey])) != HT_EMPTY_KEY)
+  {
+    if (Key == HTKey)
+      return HT_GET_CODE(table[HKey]);
+
+    HKey = (HKey + 1) & HT_KEY_MASK;
+  }
+
+  return -1;
+}
+/*--------------------------------------------*/
+/* FAST_MODE dictionary: one slot per hash value, a colliding insert
+   overwrites. The encoder may then miss a string it has already seen
+   and define it again under a new code; the decoder does not care,
+   as every code it is sent was defined for exactly that string. */
+static int FastSlot (const uint32_t Key)
+{
+  return (int)((uint32_t)(Key * 2654435761U) >> (32 - FAST_HT_BITS));
+}
+/*--------------------------------------------*/
+static void InsertDirect (const uint32_t Key, int Code, uint32_t *table)
+{
+  table[FastSlot(Key)] = HT_PUT_KEY(Key) | HT_PUT_CODE(Code);
+}
+/*--------------------------------------------*/
+static int ExistDirect (const uint32_t Key, const uint32_t *table)
+{
+  uint32_t entry = table[FastSlot(Key)];
+
+  return (HT_GET_KEY(entry) == Key) ? (int)HT_GET_CODE(entry) : -1;
+}
+/*--------------------------------------------*/
+static FORCE_INLINE size_t EncodeBlock (struct encodeState *es, const uint8_t *buffer, size_t len,
+                                        uint16_t *codes, existFn Exist, insertFn Insert, size_t tableSize)
+{
+  uint32_t *table = es->table;
+  int CurCode = es->CurCode, RunCode = es->RunCode, NewCode;
+  uint32_t NewKey;
+  size_t i = 0, n = 0;
+
+  if (len == 0)
+    return 0;
+
+  if (CurCode == NO_PHRASE)
+    CurCode = buffer[i++];
+
+  for (; i < len; i++)
+  {
+    NewKey = (((uint32_t)CurCode) << 8) + buffer[i];
+
+    if ((NewCode = Exist(NewKey, table)) >= 0)
+    {
+      CurCode = NewCode;
+    }
+    else
+    {
+      codes[n++] = (uint16_t)CurCode;
+
+      CurCode = buffer[i];
+      if (RunCode < HT_CLEAR_CODE)
+      {
+        Insert (NewKey, RunCode++, table);
+      }
+      else if (!es->freeze)
+      {
+        ClearHashTable(table, tableSize);
+        RunCode = 256;
+        codes[n++] = HT_CLEAR_CODE;
+      }
+    }
+  }
+
+  es->CurCode = CurCode;
+  es->RunCode = RunCode;
+
+  return n;
+}
+/*--------------------------------------------*/
+static size_t KERNEL(encode_block) (struct encodeState *es, const uint8_t *buffer, size_t len, uint16_t *codes)
+{
+  return EncodeBlock (es, buffer, len, codes, ExistHashTable, InsertHashTable, HT_SIZE);
+}
+/*--------------------------------------------*/
+static size_t KERNEL(encode_block_fast) (struct encodeState *es, const uint8_t *buffer, size_t len, uint16_t *codes)
+{
+  return EncodeBlock (es, buffer, len, codes, ExistDirect, InsertDirect, FAST_HT_SIZE);
+}
+/*--------------------------------------------*/
+static size_t KERNEL(pack_codes) (const uint16_t *codes, size_t count, uint8_t *out)
+{
+  size_t i = 0;
+  uint8_t *start = out;
+
+#if defined(__BMI2__) && defined(__x86_64__)
+  /* 4 codes in 16-bit lanes -> 48 contiguous bits */
+  for (; i + 4 <= count; i += 4)
+  {
+    uint64_t lanes, bits;
+
+    memcpy (&lanes, codes + i, 8);
+    bits = _pext_u64 (lanes, 0x0FFF0FFF0FFF0FFFUL);
+    memcpy (out, &bits, 6); /* assuming little endian */
+    out += 6;
+  }
+#elif defined(__SSE4_1__)
+  /* 8 codes -> 12 bytes: join pairs into 24-bit values, then gather 3 bytes of each */
+  {
+    const __m128i low = _mm_set1_epi32 (0x00000FFF);
+    const __m128i high = _mm_set1_epi32 (0x00FFF000);
+    const __m128i gather = _mm_setr_epi8 (0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    for (; i + 8 <= count; i += 8)
+    {
+      uint8_t tmp[16];
+      __m128i v = _mm_loadu_si128 ((const __m128i *)(codes + i));
+
+      v = _mm_or_si128 (_mm_and_si128 (v, low), _mm_and_si128 (_mm_srli_epi32 (v, 4), high));
+      _mm_storeu_si128 ((__m128i *)tmp, _mm_shuffle_epi8 (v, gather));
+      memcpy (out, tmp, 12);
+      out += 12;
+    }
+  }
+#endif
+
+  for (; i + 2 <= count; i += 2)
+  {
+    out[0] = (uint8_t)codes[i];
+    out[1] = (uint8_t)((codes[i] >> 8) | (codes[i + 1] << 4));
+    out[2] = (uint8_t)(codes[i + 1] >> 4);
+    out += 3;
+  }
+
+  if (i < count)
+  {
+    out[0] = (uint8_t)codes[i];
+    out[1] = (uint8_t)(codes[i] >> 8);
+    out += 2;
+  }
+
+  return out - start;
+}
+/*--------------------------------------------*/
+static size_t KERNEL(unpack_codes) (const uint8_t *in, size_t len, uint16_t *codes)
+{
+  size_t count = UNPACKED_COUNT(len), n = 0, k = 0;
+
+#if defined(__BMI2__) && defined(__x86_64__)
+  /* 6 bytes -> 4 codes in 16-bit lanes; the 8-byte load needs 2 bytes of slack */
+  for (; k + 8 <= len; k += 6)
+  {
+    uint64_t bits, lanes;
+
+    memcpy (&bits, in + k, 8); /* assuming little endian */
+    lanes = _pdep_u64 (bits, 0x0FFF0FFF0FFF0FFFUL);
+    memcpy (codes + n, &lanes, 8);
+    n += 4;
+  }
+#elif defined(__SSE4_1__)
+  /* 12 bytes -> 8 codes; each 16-bit lane gets the two bytes holding its code */
+  {
+    const __m128i spread = _mm_setr_epi8 (0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    const __m128i mask = _mm_set1_epi16 (0x0FFF);
+
+    for (; k + 16 <= len; k += 12)
+    {
+      __m128i v = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *)(in + k)), spread);
+
+      v = _mm_blend_epi16 (_mm_and_si128 (v, mask), _mm_srli_epi16 (v, 4), 0xAA);
+      _mm_storeu_si128 ((__m128i *)(codes + n), v);
+      n += 8;
+    }
+  }
+#endif
+
+  for (; n + 2 <= count; n += 2, k += 3)
+  {
+    codes[n] = in[k] | ((in[k + 1] & 0x0F) << 8);
+    codes[n + 1] = (in[k + 1] >> 4) | (in[k + 2] << 4);
+  }
+
+  if (n < count)
+  {
+    codes[n++] = in[k] | ((in[k + 1] & 0x0F) << 8);
+  }
+
+  return n;
+}
+/*--------------------------------------------*/
+static void KERNEL(insert_key) (uint32_t *table, uint32_t key, int code)
+{
+  InsertHashTable (key, code, table);
+}
+/*--------------------------------------------*/
+static void KERNEL(insert_key_fast) (uint32_t *table, uint32_t key, int code)
+{
+  InsertDirect (key, code, table);
+}
+/*--------------------------------------------*/
+
+const struct lzwKernels KERNEL(lzw_kernels) =
+{
+  KERNEL_STR(KERNEL_SUFFIX),
+  KERNEL(encode_block),
+  KERNEL(encode_block_fast),
+  KERNEL(pack_codes),
+  KERNEL(unpack_codes),
+  KERNEL(insert_key),
+  KERNEL(insert_key_fast)
+};
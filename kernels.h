@@ -0,0 +1,65 @@
+#pragma once
+
+/* Hot loops of the packer and unpacker. kernels.c is compiled once per
+   instruction set (see Makefile) and GetKernels() picks the best one the
+   CPU supports. Set LZW06_ISA=baseline|sse42|avx2 to force a level. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HT_GET_KEY(l)   (l >> 12)
+#define HT_GET_CODE(l)  (l & 0x0FFF)
+#define HT_PUT_KEY(l)   (l << 12)
+#define HT_PUT_CODE(l)  (l & 0x0FFF)
+
+#define HT_EMPTY_KEY    0xFFFFFL
+
+#define NO_PHRASE       (-1)   /* CurCode value when no phrase is open */
+
+struct encodeState
+{
+  uint32_t *table;
+  size_t tableSize;   /* HT_SIZE, or FAST_HT_SIZE in FAST_MODE */
+  int RunCode;
+  int CurCode;
+  int freeze;         /* encodeBlockFn: keep a full dictionary instead of clearing it */
+};
+
+/* Encodes len bytes continuing the open phrase (if any). Emitted codes,
+   including HT_CLEAR_CODE, go to codes[] which must hold MAX_CODES(len)
+   entries. The last phrase is left open in es->CurCode. A frozen full
+   dictionary only takes no new strings; decoders already stop adding at
+   HT_CLEAR_CODE. Returns number of codes. */
+typedef size_t (*encodeBlockFn) (struct encodeState *es, const uint8_t *buffer, size_t len, uint16_t *codes);
+
+/* 12-bit code packing; odd count leaves the last code in 2 bytes.
+   Returns number of bytes written: (3 * count + 1) / 2. */
+typedef size_t (*packCodesFn) (const uint16_t *codes, size_t count, uint8_t *out);
+
+/* Inverse of packCodesFn. Returns number of codes: 2 * len / 3. */
+typedef size_t (*unpackCodesFn) (const uint8_t *in, size_t len, uint16_t *codes);
+
+/* Adds string key (prefix code << 8 | byte) as code to a dictionary
+   table, as the encoder would; rebuilds a hibernated stream. */
+typedef void (*insertKeyFn) (uint32_t *table, uint32_t key, int code);
+
+struct lzwKernels
+{
+  const char *name;
+  encodeBlockFn encode_block;
+  encodeBlockFn encode_block_fast;   /* FAST_MODE: single probe, direct-mapped table */
+  packCodesFn pack_codes;
+  unpackCodesFn unpack_codes;
+  insertKeyFn insert_key;
+  insertKeyFn insert_key_fast;
+};
+
+const struct lzwKernels *GetKernels (void);
+
+void ClearHashTable (uint32_t *table, size_t size);
+
+/* at most one code per input byte, one HT_CLEAR_CODE per dictionary fill,
+   plus the closing phrase and EOF_CODE */
+#define MAX_CODES(len)        ((len) + (len) / (HT_CLEAR_CODE - 256) + 3)
+#define PACKED_SIZE(count)    ((3 * (count) + 1) / 2)
+#define UNPACKED_COUNT(len)   (2 * (len) / 3)
@@ -10,20 +10,1313 @@
  * implied warranty.
  */
 
+#include <csignal>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
 #include "export.h"
+#include "shmring.h"
+#include "lzwclient.h"
+#include "lzw06.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
 
-int main ()
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+typedef std::vector<std::uint8_t> Bytes;
+
+static Bytes readFile (const char *name)
+{
+    std::ifstream in (name, std::ios::binary);
+    return Bytes ((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+static void writeFile (const char *name, const Bytes &data)
+{
+    std::ofstream out (name, std::ios::binary);
+    out.write (reinterpret_cast<const char *>(data.data()), data.size());
+}
+
+static void appendNoise (Bytes &out, size_t count, int mask)
+{
+    for (size_t i = 0; i < count; i++)
+        out.push_back (static_cast<std::uint8_t>(rand() & mask));
+}
+
+/* Test input that alternates compressible text and noise: rounds times
+   copies of sample, then noise bytes of rand() & mask. Seeded, so every
+   run gets the same bytes. */
+static Bytes mixedInput (const Bytes &sample, unsigned seed, int rounds, int copies, size_t noise, int mask)
+{
+    Bytes input;
+
+    srand (seed);
+    for (int i = 0; i < rounds; i++)
+    {
+        for (int j = 0; j < copies; j++)
+            input.insert (input.end(), sample.begin(), sample.end());
+        appendNoise (input, noise, mask);
+    }
+
+    return input;
+}
+
+/* Shared corpus for the C library and lzw06.hpp: both encoders must
+   produce identical bytes and each decoder must read the other's output. */
+static bool checkCorpus (const char *sampleFile)
+{
+    const char corpusIn[] = "corpus.bin";
+    const char corpusPacked[] = "corpus.lzw";
+    const char corpusOut[] = "corpus.out";
+
+    std::vector<std::pair<std::string, Bytes>> corpus;
+
+    corpus.push_back (std::make_pair (std::string("empty"), Bytes()));
+    corpus.push_back (std::make_pair (std::string("one byte"), Bytes(1, 'x')));
+    corpus.push_back (std::make_pair (std::string(sampleFile), readFile (sampleFile)));
+
+    Bytes constant (5 * lzw06::BlockSize + 17, 0x0A), increasing;
+    Bytes random = mixedInput (Bytes(), 1, 1, 0, 4 * lzw06::BlockSize, 0x0F);
+
+    for (size_t i = 0; i < 3 * lzw06::BlockSize + 5; i++)
+        increasing.push_back (static_cast<std::uint8_t>(i & 0xFF));
+
+    corpus.push_back (std::make_pair (std::string("constant"), constant));
+    corpus.push_back (std::make_pair (std::string("increasing"), increasing));
+    corpus.push_back (std::make_pair (std::string("random"), random));
+
+    bool ok = true;
+    struct lzwContext *ctx = CreateContext (BLOCKED_OUTPUT), *ctxStream = CreateContext (0);
+
+    for (const auto &entry : corpus)
+    {
+        const Bytes &input = entry.second;
+
+        writeFile (corpusIn, input);
+
+        bool same = false;
+
+        if (Compress (corpusIn, corpusPacked, 0))
+        {
+            Bytes packedC = readFile (corpusPacked);
+            Bytes packedCpp = lzw06::compress (input.begin(), input.end());
+
+            same = (packedC == packedCpp) &&
+                   (lzw06::decompress (packedC.begin(), packedC.end()) == input) &&
+                   Decompress (corpusPacked, corpusOut, OVERWRITE_FLAG) &&
+                   (readFile (corpusOut) == input) &&
+                   DecompressParallel (corpusPacked, corpusOut, OVERWRITE_FLAG, 3) &&
+                   (readFile (corpusOut) == input);
+        }
+
+        /* fast mode must match the direct-mapped policy */
+        if (same && Compress (corpusIn, corpusPacked, FAST_MODE))
+        {
+            Bytes packedFast;
+
+            lzw06::Encoder<12, lzw06::DirectMappedDictionary> ().encode (input.begin(), input.end(),
+                                                                          std::back_inserter (packedFast));
+
+            same = (readFile (corpusPacked) == packedFast) &&
+                   (lzw06::decompress (packedFast.begin(), packedFast.end()) == input);
+        }
+
+        /* framed output has its own layout; it only has to round trip */
+        same = same && Compress (corpusIn, corpusPacked, BLOCKED_OUTPUT) &&
+               Decompress (corpusPacked, corpusOut, OVERWRITE_FLAG) &&
+               (readFile (corpusOut) == input);
+
+        /* in-memory interface writes the same images and reads both layouts */
+        if (same)
+        {
+            Bytes framed = readFile (corpusPacked), stream = lzw06::compress (input.begin(), input.end());
+            Bytes packedMem (CompressBound (input.size())), unpackedMem (input.size() + 1);
+            size_t size = 0;
+
+            same = CompressBuffer (ctx, input.data(), input.size(), packedMem.data(), packedMem.size(), &size) &&
+                   (Bytes (packedMem.begin(), packedMem.begin() + size) == framed) &&
+                   CompressBuffer (ctxStream, input.data(), input.size(), packedMem.data(), packedMem.size(), &size) &&
+                   (Bytes (packedMem.begin(), packedMem.begin() + size) == stream) &&
+                   DecompressBuffer (ctx, framed.data(), framed.size(), unpackedMem.data(), unpackedMem.size(), &size) &&
+                   (Bytes (unpackedMem.begin(), unpackedMem.begin() + size) == input) &&
+                   DecompressBuffer (ctx, stream.data(), stream.size(), unpackedMem.data(), unpackedMem.size(), &size) &&
+                   (Bytes (unpackedMem.begin(), unpackedMem.begin() + size) == input);
+        }
+
+        /* continuous layout; buffer sizes must not change any output */
+        if (same)
+        {
+            Bytes stream = readFile (corpusPacked), packedCont;
+
+            lzw06::Encoder<> (lzw06::Layout::Continuous).encode (input.begin(), input.end(),
+                                                                 std::back_inserter (packedCont));
+
+            struct lzwOptions options = {};
+
+            options.flags = CONTINUOUS_OUTPUT;
+            options.bufferSize = 1000;
+
+            same = Compress (corpusIn, corpusPacked, 0) && (stream = readFile (corpusPacked), true) &&
+                   CompressEx (corpusIn, corpusPacked, &options) && (readFile (corpusPacked) == packedCont) &&
+                   (lzw06::decompress (packedCont.begin(), packedCont.end()) == input) &&
+                   DecompressEx (corpusPacked, corpusOut, &(options.flags = OVERWRITE_FLAG, options)) &&
+                   (readFile (corpusOut) == input);
+
+            options.flags = 0;
+            options.bufferSize = 40000;
+
+            same = same && CompressEx (corpusIn, corpusPacked, &options) && (readFile (corpusPacked) == stream) &&
+                   DecompressEx (corpusPacked, corpusOut, &(options.flags = OVERWRITE_FLAG, options)) &&
+                   (readFile (corpusOut) == input);
+        }
+
+        /* narrower codes only exist on the C++ side; check they round trip */
+        Bytes packed10, unpacked10;
+
+        lzw06::Encoder<10> ().encode (input.begin(), input.end(), std::back_inserter (packed10));
+        lzw06::Decoder<10> ().decode (packed10.begin(), packed10.end(), std::back_inserter (unpacked10));
+
+        same = same && (unpacked10 == input);
+
+        printf ("Corpus '%s' (%lu bytes) : %s.\n", entry.first.c_str(),
+                (unsigned long)input.size(), same ? "Identical" : "MISMATCH");
+
+        ok = ok && same;
+    }
+
+    FreeContext (ctx);
+    FreeContext (ctxStream);
+
+    remove (corpusIn);
+    remove (corpusPacked);
+    remove (corpusOut);
+
+    return ok;
+}
+
+/* Progress must reach the full size; a cancelled job fails and removes
+   its output. DecompressParallelEx takes the same options. */
+static bool checkProgress (const char *inputFile, const char *compressedFile, const char *outputFile)
+{
+    struct lzwOptions options = {};
+    volatile sig_atomic_t cancel = 0;
+    unsigned long seen = 0;
+
+    options.progress = [] (const struct lzwProgress *p, void *user) {
+        *static_cast<unsigned long *>(user) = p->bytesIn;
+    };
+    options.user = &seen;
+    options.interval = 1;
+    options.cancel = &cancel;
+
+    bool ok = CompressEx (inputFile, compressedFile, &options) &&
+              seen == readFile (inputFile).size();
+
+    struct lzwOptions unpack = options;
+
+    unpack.flags = OVERWRITE_FLAG;
+    unpack.progress = [] (const struct lzwProgress *p, void *user) {
+        *static_cast<unsigned long *>(user) = p->bytesOut;
+    };
+    seen = 0;
+
+    ok = ok && DecompressParallelEx (compressedFile, outputFile, &unpack, 4) &&
+         seen == readFile (inputFile).size();
+
+    cancel = 1;
+    ok = ok && !DecompressParallelEx (compressedFile, outputFile, &unpack, 4) && !std::ifstream (outputFile);
+    ok = ok && !CompressEx (inputFile, compressedFile, &options) && !std::ifstream (compressedFile);
+
+    printf ("Progress and cancel : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* A file cut short before EOF_CODE must fail, not loop. */
+static bool checkTruncated (const char *inputFile, const char *compressedFile, const char *outputFile)
+{
+    bool ok = Compress (inputFile, compressedFile, 0);
+    Bytes image = readFile (compressedFile);
+
+    if (ok)
+    {
+        image.resize (image.size() - 2);
+        writeFile (compressedFile, image);
+        ok = !Decompress (compressedFile, outputFile, OVERWRITE_FLAG);
+    }
+
+    printf ("Truncated input : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* A code that is not in the dictionary yet must be rejected; here the
+   first code of the stream is 300. */
+static bool checkUnknownCode ()
+{
+    const char text[] = "abcabcabc";
+    struct lzwContext *ctx = CreateContext (0);
+    Bytes packed (CompressBound (sizeof(text))), unpacked (sizeof(text));
+    size_t size = 0;
+    bool ok = ctx && CompressBuffer (ctx, text, sizeof(text), packed.data(), packed.size(), &size);
+
+    if (ok)
+    {
+        packed[10] = 0x2C;
+        packed[11] = static_cast<std::uint8_t>((packed[11] & 0xF0) | 0x01);
+        ok = !DecompressBuffer (ctx, packed.data(), size, unpacked.data(), unpacked.size(), &size);
+    }
+
+    FreeContext (ctx);
+
+    printf ("Unknown code : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Sends a whole compress request on a new connection, without reading
+   the response. Returns the connection, or -1. */
+static int sendRequest (const char *socketPath, const Bytes &sample)
+{
+    std::uint8_t header[LZW_MSG_HEADER];
+    size_t size = sample.size(), sent = 0;
+    int fd = LzwConnect (socketPath);
+
+    header[0] = static_cast<std::uint8_t>(size);
+    header[1] = static_cast<std::uint8_t>(size >> 8);
+    header[2] = static_cast<std::uint8_t>(size >> 16);
+    header[3] = static_cast<std::uint8_t>(size >> 24);
+    header[4] = LZW_OP_COMPRESS;
+
+    bool ok = fd >= 0 && write (fd, header, sizeof(header)) == sizeof(header);
+
+    while (ok && sent < size)
+    {
+        ssize_t n = write (fd, sample.data() + sent, size - sent);
+        ok = n > 0;
+        sent += ok ? n : 0;
+    }
+
+    if (!ok && fd >= 0)
+    {
+        close (fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/* ./lzw06 --serve with several workers: a compress and a decompress
+   request round trip, clients that hang up with their request still
+   queued, then SIGTERM must stop it cleanly. */
+static bool checkServer (const Bytes &sample)
+{
+#ifdef __linux__
+    const char socketPath[] = "lzw06_test.sock";
+    void *packed = nullptr, *unpacked = nullptr;
+    size_t packedSize = 0, unpackedSize = 0;
+    int fd = -1, status = -1, exitStatus = 0;
+    bool ok;
+
+    std::remove (socketPath);
+
+    pid_t pid = fork ();
+
+    if (pid == 0)
+    {
+        execl ("./lzw06", "lzw06", "--serve", socketPath, "4", (char *)nullptr);
+        _exit (127);
+    }
+
+    for (int i = 0; pid > 0 && fd < 0 && i < 100; i++)
+    {
+        std::this_thread::sleep_for (std::chrono::milliseconds (20));
+        fd = LzwConnect (socketPath);
+    }
+
+    ok = fd >= 0 &&
+         LzwRequest (fd, LZW_OP_COMPRESS, sample.data(), sample.size(), &packed, &packedSize, &status) &&
+         status == LZW_STATUS_OK &&
+         LzwRequest (fd, LZW_OP_DECOMPRESS, packed, packedSize, &unpacked, &unpackedSize, &status) &&
+         status == LZW_STATUS_OK && unpackedSize == sample.size() &&
+         0 == memcmp (unpacked, sample.data(), sample.size());
+
+    /* more requests than the 4 workers take at once, so some are still
+       queued when their clients hang up */
+    std::vector<int> clients;
+
+    for (int i = 0; ok && i < 64; i++)
+    {
+        clients.push_back (sendRequest (socketPath, sample));
+        ok = clients.back() >= 0;
+    }
+
+    for (int client : clients)
+        if (client >= 0)
+            close (client);
+
+    free (packed);
+    packed = nullptr;
+
+    /* the server must have survived the hang-ups */
+    ok = ok &&
+         LzwRequest (fd, LZW_OP_COMPRESS, sample.data(), sample.size(), &packed, &packedSize, &status) &&
+         status == LZW_STATUS_OK && packedSize > 0;
+
+    if (fd >= 0)
+        LzwDisconnect (fd);
+
+    free (packed);
+    free (unpacked);
+
+    /* a server that misses the signal fails the check instead of hanging it */
+    pid_t done = 0;
+
+    if (pid > 0 && 0 == kill (pid, SIGTERM))
+        for (int i = 0; done == 0 && i < 250; i++)
+        {
+            std::this_thread::sleep_for (std::chrono::milliseconds (20));
+            done = waitpid (pid, &exitStatus, WNOHANG);
+        }
+
+    if (pid > 0 && done != pid)
+    {
+        kill (pid, SIGKILL);
+        waitpid (pid, nullptr, 0);
+    }
+
+    ok = done == pid && WIFEXITED (exitStatus) && WEXITSTATUS (exitStatus) == EXIT_SUCCESS && ok;
+#else
+    bool ok = true;
+    (void)sample;
+#endif
+
+    printf ("Compression server : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Compressed-domain search must report the same offsets as a plain scan
+   of the data, in every layout. The input spans several frames and has
+   long runs, so matches cross strings, phrase blocks and frames. */
+static bool checkSearch (const Bytes &sample, const char *compressedFile)
+{
+    Bytes input;
+
+    for (int i = 0; i < 100; i++)
+        input.insert (input.end(), sample.begin(), sample.end());
+
+    input.insert (input.end(), 20000, 'a');
+    input.insert (input.end(), sample.begin(), sample.end());
+
+    std::vector<std::string> patterns = { "a", "aaaa", "the", "e\n", "zqzq",
+                                          std::string (sample.begin() + 100, sample.begin() + 164),
+                                          std::string (input.end() - sample.size() - 30, input.end() - sample.size() + 30) };
+    const int layouts[] = { 0, BLOCKED_OUTPUT, CONTINUOUS_OUTPUT };
+    auto collect = [] (unsigned long offset, void *user) {
+        static_cast<std::vector<unsigned long> *>(user)->push_back (offset);
+    };
+    bool ok = true;
+
+    for (int flags : layouts)
+    {
+        struct lzwContext *ctx = CreateContext (flags);
+        Bytes packed (CompressBound (input.size()));
+        size_t packedSize = 0;
+
+        ok = ok && ctx && CompressBuffer (ctx, input.data(), input.size(), packed.data(), packed.size(), &packedSize);
+        FreeContext (ctx);
+
+        for (const std::string &pattern : patterns)
+        {
+            std::vector<unsigned long> expected, found;
+            unsigned long count = 0;
+
+            for (size_t i = 0; i + pattern.size() <= input.size(); i++)
+                if (0 == memcmp (input.data() + i, pattern.data(), pattern.size()))
+                    expected.push_back (i);
+
+            ok = ok && SearchBuffer (packed.data(), packedSize, pattern.data(), pattern.size(), collect, &found, &count) &&
+                 found == expected && count == expected.size();
+        }
+    }
+
+    unsigned long count = 0;
+
+    ok = ok && !SearchBuffer (nullptr, 0, "a", 1, nullptr, nullptr, &count) &&
+         SearchFile (compressedFile, "the", 3, nullptr, nullptr, &count);
+
+    printf ("Compressed search : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Appended frames decode as one file; stream files are refused and left
+   as they were. */
+static bool checkAppend (const char *inputFile, const char *compressedFile, const char *outputFile)
+{
+    Bytes sample = readFile (inputFile), expected;
+
+    std::remove (compressedFile);
+
+    bool ok = true;
+
+    for (int i = 0; i < 3 && ok; i++)
+    {
+        ok = Append (inputFile, compressedFile, i == 2 ? FAST_MODE : 0);
+        expected.insert (expected.end(), sample.begin(), sample.end());
+    }
+
+    ok = ok && Decompress (compressedFile, outputFile, OVERWRITE_FLAG) && readFile (outputFile) == expected &&
+         Compress (inputFile, compressedFile, 0);
+
+    Bytes stream = readFile (compressedFile);
+
+    ok = ok && !Append (inputFile, compressedFile, 0) && readFile (compressedFile) == stream;
+
+    printf ("Append frames : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+#ifdef __linux__
+static long long allocatedBytes (const char *name)
+{
+    struct stat st;
+
+    return stat (name, &st) == 0 ? static_cast<long long>(st.st_blocks) * 512 : -1;
+}
+#endif
+
+/* The input is mostly holes: the packer must read them as zeros and
+   -us/-usj must leave them as holes again. */
+static bool checkSparse (const char *inputFile, const char *compressedFile, const char *outputFile)
+{
+    const char zerosFile[] = "sparse.bin";
+    const size_t size = 8 << 20, at = 3 << 20;
+    Bytes sample = readFile (inputFile), input (size, 0);
+    bool ok = true;
+
+    std::copy (sample.begin(), sample.end(), input.begin() + at);
+
+#ifdef __linux__
+    int fd = open (zerosFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    ok = fd >= 0 && 0 == ftruncate (fd, size) &&
+         static_cast<ssize_t>(sample.size()) == pwrite (fd, sample.data(), sample.size(), at);
+
+    if (fd >= 0)
+        close (fd);
+
+    /* allocation must be well below the size */
+    auto sparse = [&] (const char *name) {
+        long long allocated = allocatedBytes (name);
+        return allocated >= 0 && allocated < static_cast<long long>(size / 4);
+    };
+
+    ok = ok && sparse (zerosFile);
+#else
+    writeFile (zerosFile, input);
+    auto sparse = [] (const char *) { return true; };
+#endif
+
+    for (int flags : { 0, static_cast<int>(BLOCKED_OUTPUT) })
+    {
+        ok = ok && Compress (zerosFile, compressedFile, flags) &&
+             Decompress (compressedFile, outputFile, OVERWRITE_FLAG | SPARSE_OUTPUT) &&
+             readFile (outputFile) == input && sparse (outputFile) &&
+             DecompressParallel (compressedFile, outputFile, OVERWRITE_FLAG | SPARSE_OUTPUT, 2) &&
+             readFile (outputFile) == input && sparse (outputFile);
+    }
+
+    std::remove (zerosFile);
+
+    printf ("Sparse output : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* A resumable job stopped again and again must end up with the file an
+   uninterrupted run writes. */
+static bool checkResume (const char *inputFile, const char *compressedFile)
+{
+    const char resumeInput[] = "resume.bin", referenceFile[] = "resume.lzw";
+    Bytes input = mixedInput (readFile (inputFile), 3, 48, 1, 20000, 0x7F);
+    std::string checkpoint = std::string (compressedFile) + ".ckpt";
+    bool ok = true;
+
+    writeFile (resumeInput, input);
+
+    for (int flags : { 0, static_cast<int>(BLOCKED_OUTPUT), static_cast<int>(CONTINUOUS_OUTPUT) })
+    {
+        struct lzwOptions options = {};
+        volatile sig_atomic_t cancel = 0;
+        std::pair<unsigned long, volatile sig_atomic_t *> stop (0, &cancel);
+        int runs = 0;
+
+        options.flags = flags | RESUMABLE_OUTPUT;
+        options.bufferSize = 16384;
+        options.checkpointInterval = 50000;
+        options.interval = 1;
+        options.cancel = &cancel;
+        options.user = &stop;
+        options.progress = [] (const struct lzwProgress *p, void *user) {
+            auto *stop = static_cast<std::pair<unsigned long, volatile sig_atomic_t *> *>(user);
+            if (p->bytesIn >= stop->first) *stop->second = 1;
+        };
+
+        std::remove (compressedFile);
+        std::remove (checkpoint.c_str());
+
+        /* cancelled before the first checkpoint: nothing to keep */
+        stop.first = 1;
+        options.checkpointInterval = input.size();
+        ok = ok && !CompressEx (resumeInput, compressedFile, &options) &&
+             !std::ifstream (compressedFile) && !std::ifstream (checkpoint);
+        options.checkpointInterval = 50000;
+
+        while (runs < 50)
+        {
+            cancel = 0;
+            stop.first = ++runs * 60000UL;
+
+            if (CompressEx (resumeInput, compressedFile, &options))
+                break;
+        }
+
+        ok = ok && runs > 1 && runs < 50 && Compress (resumeInput, referenceFile, flags) &&
+             readFile (compressedFile) == readFile (referenceFile) && !std::ifstream (checkpoint);
+    }
+
+    std::remove (resumeInput);
+    std::remove (referenceFile);
+
+    printf ("Resumable compression : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* The default policy writes what Compress does; the others must unpack
+   to the input, keep a full dictionary for a while and be refused for
+   version 0 files, which older decoders cannot read then. */
+static bool checkResetPolicy (const char *inputFile, const char *compressedFile, const char *outputFile)
+{
+    const char policyInput[] = "policy.bin", referenceFile[] = "policy.lzw";
+    Bytes input = mixedInput (readFile (inputFile), 5, 8, 4, 100000, 0xFF);
+    bool ok = true;
+
+    writeFile (policyInput, input);
+
+    for (int flags : { 0, static_cast<int>(CONTINUOUS_OUTPUT) })
+    {
+        for (int policy : { LZW_RESET_FULL, LZW_RESET_RATIO, LZW_RESET_WINDOW })
+        {
+            struct lzwOptions options = {};
+            struct lzwResetStats stats = {};
+
+            options.flags = flags;
+            options.resetPolicy = policy;
+            options.resetStats = &stats;
+
+            if (policy != LZW_RESET_FULL && flags == 0)
+            {
+                std::remove (compressedFile);
+                ok = ok && !CompressEx (policyInput, compressedFile, &options) && !std::ifstream (compressedFile);
+                continue;
+            }
+
+            ok = ok && CompressEx (policyInput, compressedFile, &options) && stats.resets > 0 &&
+                 Decompress (compressedFile, outputFile, OVERWRITE_FLAG) && readFile (outputFile) == input;
+
+            if (policy == LZW_RESET_FULL)
+                ok = ok && stats.frozenBytes == 0 && Compress (policyInput, referenceFile, flags) &&
+                     readFile (compressedFile) == readFile (referenceFile);
+            else
+                ok = ok && stats.frozenBytes > 0;
+        }
+    }
+
+    std::remove (policyInput);
+    std::remove (referenceFile);
+
+    printf ("Dictionary reset policies : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Many streams fed in turns and hibernated after each piece must give
+   what CompressBuffer does, and decode back, holding far less than
+   their tables while idle. */
+static bool checkStreams (const Bytes &sample)
+{
+    const int count = 300;
+    std::vector<Bytes> inputs (count), packed (count), unpacked (count);
+    std::vector<size_t> offsets (count, 0);
+    std::vector<struct lzwStream *> streams (count);
+    struct lzwContext *ctx[2] = { CreateContext (CONTINUOUS_OUTPUT), CreateContext (CONTINUOUS_OUTPUT | FAST_MODE) };
+    size_t idle = 0, outSize, used;
+    bool ok = ctx[0] && ctx[1];
+    int left;
+
+    srand (7);
+    for (int k = 0; k < count; k++)
+    {
+        for (int j = 0; j <= k % 8; j++)
+            inputs[k].insert (inputs[k].end(), sample.begin() + (k * 37) % sample.size(), sample.end());
+        appendNoise (inputs[k], (k * 101) % 5000, 0xFF);
+
+        streams[k] = CreateEncoderStream ((k & 1) ? FAST_MODE : 0);
+    }
+
+    for (left = count; ok && left > 0; )
+    {
+        size_t memory = 0;
+
+        for (int k = 0; ok && k < count; k++)
+        {
+            size_t piece = std::min (inputs[k].size() - offsets[k], static_cast<size_t>(rand() % 3000));
+            size_t start = packed[k].size();
+
+            if (offsets[k] == inputs[k].size())
+                continue;
+
+            packed[k].resize (start + StreamBound (piece));
+            ok = StreamCompress (streams[k], inputs[k].data() + offsets[k], piece,
+                                 packed[k].data() + start, StreamBound (piece), &outSize) &&
+                 HibernateStream (streams[k]);
+            packed[k].resize (start + outSize);
+
+            if ((offsets[k] += piece) == inputs[k].size())
+                left--;
+
+            memory += StreamMemory (streams[k]);
+        }
+
+        idle = std::max (idle, memory / count);
+    }
+
+    for (int k = 0; ok && k < count; k++)
+    {
+        size_t start = packed[k].size();
+        Bytes whole (CompressBound (inputs[k].size()));
+
+        packed[k].resize (start + StreamBound (0));
+        ok = StreamFinish (streams[k], packed[k].data() + start, StreamBound (0), &outSize) &&
+             CompressBuffer (ctx[k & 1], inputs[k].data(), inputs[k].size(), whole.data(), whole.size(), &used);
+        packed[k].resize (start + outSize);
+        whole.resize (used);
+
+        ok = ok && Bytes (whole.begin() + 10, whole.end()) == packed[k];
+
+        FreeStream (streams[k]);
+        streams[k] = CreateDecoderStream ();
+        offsets[k] = 0;
+    }
+
+    for (left = count; ok && left > 0; )
+    {
+        for (int k = 0; ok && k < count; k++)
+        {
+            size_t piece = std::min (packed[k].size() - offsets[k], static_cast<size_t>(rand() % 1000));
+            size_t start = unpacked[k].size();
+
+            if (StreamEnded (streams[k]))
+                continue;
+
+            unpacked[k].resize (start + 5000);
+            ok = StreamDecompress (streams[k], packed[k].data() + offsets[k], piece, &used,
+                                   unpacked[k].data() + start, 5000, &outSize) &&
+                 HibernateStream (streams[k]);
+            unpacked[k].resize (start + outSize);
+            offsets[k] += used;
+
+            if (StreamEnded (streams[k]))
+            {
+                ok = ok && unpacked[k] == inputs[k] && offsets[k] == packed[k].size();
+                left--;
+            }
+        }
+    }
+
+    for (int k = 0; k < count; k++)
+        FreeStream (streams[k]);
+
+    FreeContext (ctx[0]);
+    FreeContext (ctx[1]);
+
+    ok = ok && idle < 16384;
+
+    printf ("Compact streams (%lu bytes per idle stream) : %s.\n",
+            static_cast<unsigned long>(idle), ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Repeated data, shifted by an insert, must be stored once; the file and
+   its in-memory image unpack to the input. */
+static bool checkDedup (const char *compressedFile, const char *outputFile)
+{
+    const char dedupInput[] = "dedup.bin", referenceFile[] = "dedup.lzw";
+    Bytes noise = mixedInput (Bytes(), 9, 1, 0, 600000, 0xFF), input, image, unpacked;
+    struct lzwContext *ctx = CreateContext (0);
+    size_t size = 0;
+    bool ok = ctx != nullptr;
+
+    input = noise;
+    input.insert (input.end(), noise.begin(), noise.end());
+    input.push_back ('x');
+    input.insert (input.end(), noise.begin() + 1000, noise.end());
+
+    writeFile (dedupInput, input);
+
+    ok = ok && Compress (dedupInput, compressedFile, DEDUP_OUTPUT) &&
+         Compress (dedupInput, referenceFile, BLOCKED_OUTPUT) &&
+         3 * readFile (compressedFile).size() < 2 * readFile (referenceFile).size() &&
+         Decompress (compressedFile, outputFile, OVERWRITE_FLAG) && readFile (outputFile) == input;
+
+    if (ok)
+    {
+        image = readFile (compressedFile);
+        unpacked.resize (input.size());
+        ok = DecompressBuffer (ctx, image.data(), image.size(), unpacked.data(), unpacked.size(), &size) &&
+             size == input.size() && unpacked == input;
+    }
+
+    FreeContext (ctx);
+    std::remove (dedupInput);
+    std::remove (referenceFile);
+
+    printf ("Deduplication : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Scattered reads from several threads through a small cache must
+   match the input; a repeated read is served from the cache. */
+static bool checkReader (const char *inputFile, const char *compressedFile)
+{
+    Bytes sample = readFile (inputFile), expected;
+    bool ok = true;
+
+    std::remove (compressedFile);
+
+    for (int i = 0; i < 8 && ok; i++)
+    {
+        ok = Append (inputFile, compressedFile, 0);
+        expected.insert (expected.end(), sample.begin(), sample.end());
+    }
+
+    struct lzwReader *r = ok ? OpenReader (compressedFile, 2) : nullptr;
+    std::atomic<bool> same (r != nullptr && ReaderSize (r) == expected.size());
+    std::vector<std::thread> readers;
+
+    for (int t = 0; t < 4 && same; t++)
+    {
+        readers.emplace_back ([&, t] () {
+            unsigned long seed = 7 + t;
+            Bytes buf (5000);
+
+            for (int i = 0; i < 200 && same; i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                unsigned long offset = (seed >> 8) % (expected.size() + 100);
+                long got = ReaderRead (r, buf.data(), buf.size(), offset);
+                size_t want = offset < expected.size() ? std::min (buf.size(), expected.size() - offset) : 0;
+
+                if (got != static_cast<long>(want) || !std::equal (buf.begin(), buf.begin() + want, expected.begin() + offset))
+                    same = false;
+            }
+        });
+    }
+
+    for (auto &t : readers)
+        t.join();
+
+    unsigned long hits = 0, misses = 0, lastHits = 0, lastMisses = 0;
+    Bytes buf (100);
+
+    if (r)
+    {
+        ReaderRead (r, buf.data(), buf.size(), 12345);
+        ReaderStats (r, &lastHits, &lastMisses);
+        ReaderRead (r, buf.data(), buf.size(), 12345);
+        ReaderStats (r, &hits, &misses);
+        CloseReader (r);
+    }
+
+    ok = ok && same && hits == lastHits + 1 && misses == lastMisses &&
+         std::equal (buf.begin(), buf.end(), expected.begin() + 12345) &&
+         Compress (inputFile, compressedFile, 0) && OpenReader (compressedFile, 0) == nullptr;
+
+    printf ("Random access reader : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Small inputs are packed whole, so the estimate is exact; sampled ones
+   must come within a few percent. */
+static bool checkEstimate (const char *inputFile, const char *compressedFile)
+{
+    Bytes sample = readFile (inputFile), input = mixedInput (sample, 2, 64, 1, 30000, 0x3F);
+    double ratio = 0, sampled = 0;
+
+    struct lzwContext *ctx = CreateContext (0);
+    Bytes packed (CompressBound (input.size()));
+    size_t packedSize = 0;
+
+    bool ok = Compress (inputFile, compressedFile, 0) &&
+              EstimateFileRatio (inputFile, 0, 0, &ratio) &&
+              static_cast<size_t>(ratio * sample.size() + 0.5) == readFile (compressedFile).size() &&
+              ctx && CompressBuffer (ctx, input.data(), input.size(), packed.data(), packed.size(), &packedSize) &&
+              EstimateRatio (input.data(), input.size(), 256 * 1024, 0, &sampled) &&
+              sampled > 0.95 * packedSize / input.size() && sampled < 1.05 * packedSize / input.size();
+
+    FreeContext (ctx);
+
+    printf ("Ratio estimate : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Producer thread -> input ring -> CompressRing -> output ring -> here.
+   The input ring is small so records wrap around it. */
+static bool checkRing (const Bytes &sample)
+{
+    const char inRing[] = "/lzw06_test_in";
+    const char outRing[] = "/lzw06_test_out";
+
+    RingUnlink (inRing);
+    RingUnlink (outRing);
+
+    struct shmRing *in = RingOpen (inRing, 1 << 15);
+    struct shmRing *out = RingOpen (outRing, 1 << 16);
+
+    if (!in || !out)
+        return false;
+
+    const int records = 200;
+    auto recordSize = [&] (int i) { return (i * 997) % (RingMaxRecord (in) + 1); };
+    auto recordByte = [&] (int i, size_t k) { return sample[(i + k) % sample.size()]; };
+
+    std::atomic<bool> stopped (false);
+
+    std::thread producer ([&] {
+        for (int i = 0, spins = 0; i < records; i++)
+        {
+            void *p;
+
+            while ((p = RingReserve (in, recordSize (i))) == NULL && !stopped)
+                RingBackoff (&spins);
+
+            if (p == NULL)
+                break;
+
+            for (size_t k = 0; k < recordSize (i); k++)
+                static_cast<std::uint8_t *>(p)[k] = recordByte (i, k);
+
+            RingCommit (in, recordSize (i));
+        }
+
+        RingClose (in);
+    });
+
+    struct lzwOptions options = {};
+    bool compressed = false;
+
+    std::thread compressor ([&] {
+        compressed = CompressRing (inRing, outRing, NULL, &options);
+        stopped = true;
+    });
+
+    struct lzwContext *ctx = CreateContext (0);
+    Bytes unpacked (RingMaxRecord (in));
+    bool ok = true;
+    int seen = 0, spins = 0;
+
+    while (!RingFinished (out))
+    {
+        size_t len, size = 0;
+        const void *record = RingPeek (out, &len);
+
+        if (record == NULL)
+        {
+            RingBackoff (&spins);
+            continue;
+        }
+
+        ok = ok && DecompressBuffer (ctx, record, len, unpacked.data(), unpacked.size(), &size) &&
+             size == recordSize (seen);
+
+        for (size_t k = 0; ok && k < size; k++)
+            ok = unpacked[k] == recordByte (seen, k);
+
+        RingRelease (out);
+        seen++;
+    }
+
+    producer.join ();
+    compressor.join ();
+
+    ok = ok && compressed && seen == records;
+
+    FreeContext (ctx);
+    RingDetach (in);
+    RingDetach (out);
+    RingUnlink (outRing);
+
+    /* a finished ring left behind is not read as finished by the next job */
+    if ((in = RingOpen (inRing, 1 << 15)) != nullptr)
+        RingClose (in);
+    RingDetach (in);
+
+    in = RingOpen (inRing, 1 << 15);
+    ok = ok && in && !RingFinished (in);
+    RingDetach (in);
+    RingUnlink (inRing);
+
+    printf ("Shared memory ring : %s.\n", ok ? "Successful" : "Failed");
+
+    return ok;
+}
+
+/* Profiling mode: lzw_test --profile [--json] [-x] [-b] file...
+   Packs and unpacks each file in memory under Linux hardware counters
+   (perf_event_open, user space only) and prints one CSV or JSON row per
+   file and direction, raw and per input Mb and per code. A counter the
+   machine or perf_event_paranoid does not allow is left empty; with none
+   the rows carry the time only. Codes are counted from the code bytes,
+   3 bytes per 2 codes, leaving out the file and frame headers. */
+struct counterSpec
+{
+    const char *name;
+    std::uint32_t type;
+    std::uint64_t config;
+};
+
+#ifdef __linux__
+#define HW_CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const counterSpec counterSpecs[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "l1d_misses", PERF_TYPE_HW_CACHE, HW_CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "llc_misses", PERF_TYPE_HW_CACHE, HW_CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES }
+};
+#else
+static const counterSpec counterSpecs[] = {
+    { "cycles", 0, 0 }, { "instructions", 0, 0 }, { "l1d_misses", 0, 0 },
+    { "llc_misses", 0, 0 }, { "branch_misses", 0, 0 }
+};
+#endif
+
+enum { COUNTERS = sizeof(counterSpecs) / sizeof(counterSpecs[0]) };
+
+class Counters
+{
+public:
+    Counters ()
+    {
+        for (int i = 0; i < COUNTERS; i++)
+            fd[i] = openCounter (counterSpecs[i]);
+    }
+
+    ~Counters ()
+    {
+#ifdef __linux__
+        for (int i = 0; i < COUNTERS; i++)
+            if (fd[i] >= 0)
+                close (fd[i]);
+#endif
+    }
+
+    bool any () const
+    {
+        return std::any_of (fd, fd + COUNTERS, [] (int f) { return f >= 0; });
+    }
+
+    void start ()
+    {
+#ifdef __linux__
+        for (int i = 0; i < COUNTERS; i++)
+            if (fd[i] >= 0)
+            {
+                ioctl (fd[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl (fd[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    /* value[i] < 0: not counted. Scaled up if the kernel multiplexed it. */
+    void stop (double value[COUNTERS])
+    {
+        for (int i = 0; i < COUNTERS; i++)
+        {
+            value[i] = -1;
+#ifdef __linux__
+            std::uint64_t v[3];
+
+            if (fd[i] < 0)
+                continue;
+
+            ioctl (fd[i], PERF_EVENT_IOC_DISABLE, 0);
+
+            if (read (fd[i], v, sizeof(v)) == sizeof(v) && v[2] > 0)
+                value[i] = static_cast<double>(v[0]) * v[1] / v[2];
+#endif
+        }
+    }
+
+private:
+    int fd[COUNTERS];
+
+    static int openCounter (const counterSpec &spec)
+    {
+#ifdef __linux__
+        struct perf_event_attr attr;
+
+        memset (&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)spec;
+        return -1;
+#endif
+    }
+};
+
+struct profileRow
+{
+    std::string file, op;
+    size_t bytes, codes;
+    long long usec;
+    double value[COUNTERS];
+};
+
+static std::string jsonString (const std::string &s)
+{
+    std::string quoted ("\"");
+
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+
+    return quoted + "\"";
+}
+
+static void printRows (const std::vector<profileRow> &rows, bool json)
+{
+    const char *scale[] = { "", "_per_mb", "_per_code" };
+
+    if (json)
+        printf ("[\n");
+    else
+    {
+        printf ("file,op,bytes,codes,usec");
+        for (const char *s : scale)
+            for (int i = 0; i < COUNTERS; i++)
+                printf (",%s%s", counterSpecs[i].name, s);
+        printf ("\n");
+    }
+
+    for (size_t r = 0; r < rows.size(); r++)
+    {
+        const profileRow &row = rows[r];
+        const double divisor[] = { 1, row.bytes / 1048576.0, static_cast<double>(row.codes) };
+
+        if (json)
+            printf ("  {\"file\": %s, \"op\": \"%s\", \"bytes\": %zu, \"codes\": %zu, \"usec\": %lld",
+                    jsonString (row.file).c_str(), row.op.c_str(), row.bytes, row.codes, row.usec);
+        else
+            printf ("%s,%s,%zu,%zu,%lld", row.file.c_str(), row.op.c_str(), row.bytes, row.codes, row.usec);
+
+        for (int s = 0; s < 3; s++)
+            for (int i = 0; i < COUNTERS; i++)
+            {
+                bool counted = row.value[i] >= 0 && divisor[s] > 0;
+
+                if (json)
+                {
+                    printf (", \"%s%s\": ", counterSpecs[i].name, scale[s]);
+                    counted ? printf ("%.*f", s ? 2 : 0, row.value[i] / divisor[s]) : printf ("null");
+                }
+                else
+                    counted ? printf (",%.*f", s ? 2 : 0, row.value[i] / divisor[s]) : printf (",");
+            }
+
+        if (json)
+            printf ("}%s\n", r + 1 < rows.size() ? "," : "");
+        else
+            printf ("\n");
+    }
+
+    if (json)
+        printf ("]\n");
+}
+
+/* unlike readFile, tells a missing or unreadable file from an empty one */
+static bool loadFile (const char *name, Bytes &data)
+{
+    FILE *fp = fopen (name, "rb");
+    std::uint8_t buffer[65536];
+    size_t len;
+    bool ok;
+
+    if (fp == nullptr)
+        return false;
+
+    while ((len = fread (buffer, 1, sizeof(buffer), fp)) > 0)
+        data.insert (data.end(), buffer, buffer + len);
+
+    ok = !ferror (fp);
+    fclose (fp);
+
+    return ok;
+}
+
+/* CompressBuffer output: a 10-byte header, then the codes or, with -b,
+   frames of an 8-byte header (rawSize, packedSize) and their codes */
+static size_t countCodes (const Bytes &packed, size_t size, bool framed)
+{
+    size_t pos = 10, codes = 0, bytes;
+
+    if (!framed)
+        return (size - pos) * 2 / 3;
+
+    for (; pos + 8 <= size; pos += 8 + bytes)
+    {
+        bytes = packed[pos + 4] | packed[pos + 5] << 8 | packed[pos + 6] << 16 |
+                static_cast<size_t>(packed[pos + 7]) << 24;
+        codes += bytes * 2 / 3;
+    }
+
+    return codes;
+}
+
+static int profile (int argc, char **argv)
+{
+    std::vector<const char *> files;
+    std::vector<profileRow> rows;
+    bool json = false;
+    int flags = 0;
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (!strcmp (argv[i], "--json"))
+            json = true;
+        else if (!strcmp (argv[i], "-x"))
+            flags |= FAST_MODE;
+        else if (!strcmp (argv[i], "-b"))
+            flags |= BLOCKED_OUTPUT;
+        else
+            files.push_back (argv[i]);
+    }
+
+    if (files.empty())
+    {
+        fprintf (stderr, "Syntax: lzw_test --profile [--json] [-x] [-b] file...\n");
+        return EXIT_FAILURE;
+    }
+
+    struct lzwContext *ctx = CreateContext (flags);
+    Counters counters;
+
+    if (ctx == nullptr)
+        return EXIT_FAILURE;
+
+    if (!counters.any())
+        fprintf (stderr, "Hardware counters are not available; timing only.\n");
+
+    for (const char *name : files)
+    {
+        Bytes input;
+        size_t packedSize = 0, unpackedSize = 0;
+        profileRow row[2];
+
+        if (!loadFile (name, input))
+        {
+            fprintf (stderr, "Cannot read '%s'.\n", name);
+            perror (nullptr);
+            FreeContext (ctx);
+            return EXIT_FAILURE;
+        }
+
+        Bytes packed (CompressBound (input.size())), unpacked (input.size());
+
+        for (int op = 0; op < 2; op++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            int ret;
+
+            counters.start();
+
+            ret = op ? DecompressBuffer (ctx, packed.data(), packedSize, unpacked.data(), unpacked.size(), &unpackedSize)
+                     : CompressBuffer (ctx, input.data(), input.size(), packed.data(), packed.size(), &packedSize);
+
+            counters.stop (row[op].value);
+
+            auto end = std::chrono::high_resolution_clock::now();
+
+            if (!ret || (op && (unpackedSize != input.size() || unpacked != input)))
+            {
+                fprintf (stderr, "%s: %s failed.\n", name, op ? "unpack" : "pack");
+                FreeContext (ctx);
+                return EXIT_FAILURE;
+            }
+
+            row[op].file = name;
+            row[op].op = op ? "unpack" : "pack";
+            row[op].bytes = input.size();
+            row[op].usec = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+        }
+
+        row[0].codes = row[1].codes = countCodes (packed, packedSize, (flags & BLOCKED_OUTPUT) != 0);
+        rows.push_back (row[0]);
+        rows.push_back (row[1]);
+    }
+
+    FreeContext (ctx);
+    printRows (rows, json);
+
+    return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
 {
     const char inputFile[] = "sample.txt";
     const char compressedFile[] = "sample.lzw";
     const char outputFile[] = "sample_copy.txt";
 
+    if (argc > 1 && !strcmp (argv[1], "--profile"))
+        return profile (argc - 2, argv + 2);
+
     std::chrono::high_resolution_clock::time_point start;
 
     start = std::chrono::high_resolution_clock::now();
@@ -54,6 +1347,53 @@ int main ()
 
     std::cout << duration.count() << " microsecs\n";
 
+    if (!checkCorpus (inputFile))
+        return EXIT_FAILURE;
+
+    if (!checkProgress (inputFile, compressedFile, outputFile))
+        return EXIT_FAILURE;
+
+    if (!checkTruncated (inputFile, compressedFile, outputFile))
+        return EXIT_FAILURE;
+
+    if (!checkUnknownCode ())
+        return EXIT_FAILURE;
+
+    if (!checkServer (readFile (inputFile)))
+        return EXIT_FAILURE;
+
+    if (!checkRing (readFile (inputFile)))
+        return EXIT_FAILURE;
+
+    Compress (inputFile, compressedFile, 0);
+
+    if (!checkSearch (readFile (inputFile), compressedFile))
+        return EXIT_FAILURE;
+
+    if (!checkEstimate (inputFile, compressedFile))
+        return EXIT_FAILURE;
+
+    if (!checkAppend (inputFile, compressedFile, outputFile))
+        return EXIT_FAILURE;
+
+    if (!checkSparse (inputFile, compressedFile, outputFile))
+        return EXIT_FAILURE;
+
+    if (!checkReader (inputFile, compressedFile))
+        return EXIT_FAILURE;
+
+    if (!checkResume (inputFile, compressedFile))
+        return EXIT_FAILURE;
+
+    if (!checkResetPolicy (inputFile, compressedFile, outputFile))
+        return EXIT_FAILURE;
+
+    if (!checkStreams (readFile (inputFile)))
+        return EXIT_FAILURE;
+
+    if (!checkDedup (compressedFile, outputFile))
+        return EXIT_FAILURE;
+
     return EXIT_SUCCESS;
 
 }
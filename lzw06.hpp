@@ -0,0 +1,497 @@
+/* LZW fixed-width codec, header-only C++17 interface.
+ * Copyright (c) 1996-2021 Yuriy Yakimenko
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation.  No representations are made about the suitability of this
+ * software for any purpose.  It is provided "as is" without express or
+ * implied warranty.
+ */
+
+/*------------------------------------------------------------*/
+/*                                                            */
+/*  Template version of Compress/Decompress working on        */
+/*  iterator ranges instead of file names. With MaxBits = 12  */
+/*  the output is byte-for-byte identical to the C library    */
+/*  (see libtest.cpp), so both can read each other's files.   */
+/*                                                            */
+/*------------------------------------------------------------*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+namespace lzw06
+{
+
+/* Input is split into blocks of this size and every block starts a new
+   phrase. Must match BUFFLEN in common.h to stay compatible. */
+inline constexpr std::size_t BlockSize = 16384;
+
+inline constexpr std::uint8_t FormatVersion = 0;
+
+/* FormatVersion without the phrase break every BlockSize bytes (-c). */
+inline constexpr std::uint8_t ContinuousVersion = 2;
+
+enum class Layout { Blocks, Continuous };
+
+inline constexpr std::size_t HeaderSize = 10;
+
+class FormatError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+template <unsigned MaxBits>
+struct Limits
+{
+    static_assert (MaxBits >= 9 && MaxBits <= 16, "MaxBits must be between 9 and 16");
+
+    static constexpr unsigned      bits      = MaxBits;
+    static constexpr std::uint32_t maxCode   = 1u << MaxBits;
+    static constexpr std::uint32_t eofCode   = maxCode - 1;
+    static constexpr std::uint32_t clearCode = maxCode - 2;
+    static constexpr std::uint32_t firstCode = 256;
+    static constexpr std::uint32_t hashSize  = maxCode * 2;
+    static constexpr std::uint32_t hashMask  = hashSize - 1;
+
+    /* same layout as infoBits in Compress: endianness, variable width, MAX_BITS - 8 */
+    static constexpr std::uint8_t  infoBits  = static_cast<std::uint8_t>((MaxBits - 8) << 4);
+};
+
+/*--------------------------------------------------------------------*/
+/* Dictionary policies. A policy maps key = (code << 8) + byte to a   */
+/* code; find() returns -1 when the string is not in the table.       */
+/*--------------------------------------------------------------------*/
+
+/* Open addressing with linear probing, same as the C encoder. */
+template <unsigned MaxBits>
+class LinearProbeDictionary
+{
+    using L = Limits<MaxBits>;
+
+public:
+    LinearProbeDictionary () : keys_(L::hashSize), codes_(L::hashSize) { clear (); }
+
+    void clear ()
+    {
+        std::fill (keys_.begin(), keys_.end(), emptyKey);
+    }
+
+    int find (std::uint32_t key) const
+    {
+        std::uint32_t h = slot (key);
+
+        while (keys_[h] != emptyKey)
+        {
+            if (keys_[h] == key)
+                return codes_[h];
+
+            h = (h + 1) & L::hashMask;
+        }
+
+        return -1;
+    }
+
+    void insert (std::uint32_t key, std::uint16_t code)
+    {
+        std::uint32_t h = slot (key);
+
+        while (keys_[h] != emptyKey)
+            h = (h + 1) & L::hashMask;
+
+        keys_[h] = key;
+        codes_[h] = code;
+    }
+
+private:
+    static constexpr std::uint32_t emptyKey = 0xFFFFFFFFu;
+
+    static std::uint32_t slot (std::uint32_t key)
+    {
+        return ((key >> MaxBits) ^ key) & L::hashMask;
+    }
+
+    std::vector<std::uint32_t> keys_;
+    std::vector<std::uint16_t> codes_;
+};
+
+/* Single probe into a direct-mapped table; a colliding insert overwrites.
+   Same as FAST_MODE in the C library: the ratio is a little worse, but
+   the stream is valid for any decoder. */
+template <unsigned MaxBits>
+class DirectMappedDictionary
+{
+public:
+    static constexpr unsigned tableBits = MaxBits + 3;
+
+    DirectMappedDictionary () : keys_(1u << tableBits), codes_(1u << tableBits) { clear (); }
+
+    void clear ()
+    {
+        std::fill (keys_.begin(), keys_.end(), emptyKey);
+    }
+
+    int find (std::uint32_t key) const
+    {
+        const std::uint32_t h = slot (key);
+        return (keys_[h] == key) ? codes_[h] : -1;
+    }
+
+    void insert (std::uint32_t key, std::uint16_t code)
+    {
+        const std::uint32_t h = slot (key);
+        keys_[h] = key;
+        codes_[h] = code;
+    }
+
+private:
+    static constexpr std::uint32_t emptyKey = 0xFFFFFFFFu;
+
+    static std::uint32_t slot (std::uint32_t key)
+    {
+        return static_cast<std::uint32_t>(key * 2654435761u) >> (32 - tableBits);
+    }
+
+    std::vector<std::uint32_t> keys_;
+    std::vector<std::uint16_t> codes_;
+};
+
+/*--------------------------------------------------------------------*/
+
+namespace detail
+{
+
+/* Codes are stored least significant bit first, which for 12 bits is
+   exactly what OutCode does on a little endian machine. */
+template <unsigned Bits, class OutputIt>
+class BitWriter
+{
+public:
+    explicit BitWriter (OutputIt out) : out_(out) {}
+
+    void put (std::uint32_t code)
+    {
+        acc_ |= code << count_;
+        count_ += Bits;
+
+        while (count_ >= 8)
+        {
+            *out_++ = static_cast<std::uint8_t>(acc_ & 0xFF);
+            acc_ >>= 8;
+            count_ -= 8;
+        }
+    }
+
+    OutputIt flush ()
+    {
+        if (count_ > 0)
+        {
+            *out_++ = static_cast<std::uint8_t>(acc_ & 0xFF);
+            acc_ = 0;
+            count_ = 0;
+        }
+        return out_;
+    }
+
+private:
+    OutputIt out_;
+    std::uint32_t acc_ = 0;
+    unsigned count_ = 0;
+};
+
+template <unsigned Bits, class InputIt>
+class BitReader
+{
+public:
+    BitReader (InputIt first, InputIt last) : first_(first), last_(last) {}
+
+    /* returns false when input runs out before a full code */
+    bool get (std::uint32_t &code)
+    {
+        while (count_ < Bits)
+        {
+            if (first_ == last_)
+                return false;
+
+            acc_ |= static_cast<std::uint32_t>(static_cast<std::uint8_t>(*first_++)) << count_;
+            count_ += 8;
+        }
+
+        code = acc_ & ((1u << Bits) - 1);
+        acc_ >>= Bits;
+        count_ -= Bits;
+        return true;
+    }
+
+private:
+    InputIt first_, last_;
+    std::uint32_t acc_ = 0;
+    unsigned count_ = 0;
+};
+
+template <class T>
+std::uint8_t to_byte (T v)
+{
+    return static_cast<std::uint8_t>(v);
+}
+
+} // namespace detail
+
+/*--------------------------------------------------------------------*/
+
+template <unsigned MaxBits = 12, template <unsigned> class DictionaryPolicy = LinearProbeDictionary>
+class Encoder
+{
+    using L = Limits<MaxBits>;
+
+public:
+    explicit Encoder (Layout layout = Layout::Blocks) : layout_(layout) {}
+
+    /* Writes a complete .lzw image (header and codes) of [first, last) to out. */
+    template <class ForwardIt, class OutputIt>
+    OutputIt encode (ForwardIt first, ForwardIt last, OutputIt out)
+    {
+        const auto size = std::distance (first, last);
+
+        if (static_cast<unsigned long long>(size) > std::numeric_limits<std::uint32_t>::max())
+            throw std::length_error ("lzw06: input larger than 4GB");
+
+        const std::uint32_t inputSize = static_cast<std::uint32_t>(size);
+        const std::uint8_t header[HeaderSize] = {
+            'L', 'Z', 'W', 0,
+            layout_ == Layout::Continuous ? ContinuousVersion : FormatVersion, L::infoBits,
+            static_cast<std::uint8_t>(inputSize), static_cast<std::uint8_t>(inputSize >> 8),
+            static_cast<std::uint8_t>(inputSize >> 16), static_cast<std::uint8_t>(inputSize >> 24) };
+
+        for (std::uint8_t b : header)
+            *out++ = b;
+
+        detail::BitWriter<MaxBits, OutputIt> bits (out);
+
+        std::uint32_t RunCode = L::firstCode, CurCode = 0;
+        std::size_t inBlock = 0;
+
+        dict_.clear ();
+
+        for (; first != last; ++first)
+        {
+            const std::uint8_t c = detail::to_byte (*first);
+
+            if (inBlock == 0)
+            {
+                CurCode = c;
+            }
+            else
+            {
+                const std::uint32_t NewKey = (CurCode << 8) + c;
+                const int NewCode = dict_.find (NewKey);
+
+                if (NewCode >= 0)
+                {
+                    CurCode = static_cast<std::uint32_t>(NewCode);
+                }
+                else
+                {
+                    bits.put (CurCode);
+                    CurCode = c;
+
+                    if (RunCode == L::clearCode)
+                    {
+                        dict_.clear ();
+                        RunCode = L::firstCode;
+                        bits.put (L::clearCode);
+                    }
+                    else
+                    {
+                        dict_.insert (NewKey, static_cast<std::uint16_t>(RunCode++));
+                    }
+                }
+            }
+
+            if (++inBlock == BlockSize && layout_ == Layout::Blocks)
+            {
+                bits.put (CurCode);
+                inBlock = 0;
+            }
+        }
+
+        if (inBlock != 0)
+            bits.put (CurCode);
+
+        bits.put (L::eofCode);
+
+        return bits.flush ();
+    }
+
+#ifdef __cpp_lib_span
+    template <class OutputIt>
+    OutputIt encode (std::span<const std::uint8_t> in, OutputIt out)
+    {
+        return encode (in.begin(), in.end(), out);
+    }
+#endif
+
+private:
+    DictionaryPolicy<MaxBits> dict_;
+    Layout layout_;
+};
+
+/*--------------------------------------------------------------------*/
+
+template <unsigned MaxBits = 12>
+class Decoder
+{
+    using L = Limits<MaxBits>;
+
+public:
+    Decoder () : prefix_(L::maxCode), suffix_(L::maxCode), first_(L::maxCode), stack_(L::maxCode) {}
+
+    /* Reads a complete .lzw image from [first, last) and writes the original
+       bytes to out. Throws FormatError on malformed input. */
+    template <class InputIt, class OutputIt>
+    OutputIt decode (InputIt first, InputIt last, OutputIt out)
+    {
+        std::array<std::uint8_t, HeaderSize> header {};
+
+        for (auto &b : header)
+        {
+            if (first == last)
+                throw FormatError ("lzw06: truncated header");
+            b = detail::to_byte (*first++);
+        }
+
+        if (header[0] != 'L' || header[1] != 'Z' || header[2] != 'W')
+            throw FormatError ("lzw06: not an LZW file");
+
+        if (header[4] != FormatVersion && header[4] != ContinuousVersion)
+            throw FormatError ("lzw06: packer/unpacker version mismatch");
+
+        const bool blocks = (header[4] == FormatVersion);
+
+        if (header[5] != L::infoBits)
+            throw FormatError ("lzw06: encoding flags mismatch");
+
+        const std::uint32_t expectedSize = header[6] | (header[7] << 8) | (header[8] << 16) |
+                                           (static_cast<std::uint32_t>(header[9]) << 24);
+
+        detail::BitReader<MaxBits, InputIt> bits (first, last);
+
+        constexpr std::uint32_t NotCode = std::numeric_limits<std::uint32_t>::max();
+
+        std::uint32_t RunCode = L::firstCode, OldCode = NotCode, code = 0;
+        std::uint32_t produced = 0;
+
+        for (std::uint32_t c = 0; c < 256; c++)
+            first_[c] = static_cast<std::uint8_t>(c);
+
+        while (bits.get (code))
+        {
+            if (code == L::eofCode)
+            {
+                if (produced != expectedSize)
+                    throw FormatError ("lzw06: expected and actual sizes don't match");
+                return out;
+            }
+
+            if (code == L::clearCode)
+            {
+                RunCode = L::firstCode;
+                OldCode = NotCode;
+                continue;
+            }
+
+            std::size_t n = 0;
+            std::uint32_t cur = code;
+
+            if (code >= RunCode)
+            {
+                /* KwKwK case: the code being defined is used right away */
+                if (code != RunCode || OldCode == NotCode)
+                    throw FormatError ("lzw06: invalid code");
+
+                stack_[n++] = first_[OldCode];
+                cur = OldCode;
+            }
+
+            while (cur >= L::firstCode)
+            {
+                stack_[n++] = suffix_[cur];
+                cur = prefix_[cur];
+            }
+            stack_[n++] = static_cast<std::uint8_t>(cur);
+
+            produced += static_cast<std::uint32_t>(n);
+
+            while (n != 0)
+                *out++ = stack_[--n];
+
+            if (OldCode != NotCode && RunCode < L::clearCode)
+            {
+                prefix_[RunCode] = static_cast<std::uint16_t>(OldCode);
+                suffix_[RunCode] = static_cast<std::uint8_t>(cur);
+                first_[RunCode] = first_[OldCode];
+                RunCode++;
+            }
+
+            OldCode = code;
+
+            /* every input block of the encoder ends a phrase */
+            if (blocks && produced % BlockSize == 0)
+                OldCode = NotCode;
+        }
+
+        throw FormatError ("lzw06: unexpected end of input");
+    }
+
+#ifdef __cpp_lib_span
+    template <class OutputIt>
+    OutputIt decode (std::span<const std::uint8_t> in, OutputIt out)
+    {
+        return decode (in.begin(), in.end(), out);
+    }
+#endif
+
+private:
+    std::vector<std::uint16_t> prefix_;
+    std::vector<std::uint8_t> suffix_;
+    std::vector<std::uint8_t> first_;
+    std::vector<std::uint8_t> stack_;
+};
+
+/*--------------------------------------------------------------------*/
+/* Convenience wrappers.                                              */
+/*--------------------------------------------------------------------*/
+
+template <class ForwardIt>
+std::vector<std::uint8_t> compress (ForwardIt first, ForwardIt last)
+{
+    std::vector<std::uint8_t> out;
+    out.reserve (HeaderSize + std::distance (first, last) / 2);
+    Encoder<> ().encode (first, last, std::back_inserter (out));
+    return out;
+}
+
+template <class InputIt>
+std::vector<std::uint8_t> decompress (InputIt first, InputIt last)
+{
+    std::vector<std::uint8_t> out;
+    Decoder<> ().decode (first, last, std::back_inserter (out));
+    return out;
+}
+
+} // namespace lzw06
@@ -0,0 +1,303 @@
+/* In-memory compression with caller owned, reusable state. See export.h. */
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+struct lzwContext
+{
+  const struct lzwKernels *kernels;
+  encodeBlockFn encode_block;
+  int flags;
+
+  struct encodeState es;
+  uint16_t *frameCodes;            /* MAX_CODES(FRAME_SIZE) */
+  uint8_t *outline;                /* one frame record */
+
+  struct unpackHelper uh;
+  uint16_t *codes;                 /* decoder scratch, grows on demand */
+  size_t codesCap;
+};
+
+/*--------------------------------------------------------------------*/
+
+struct lzwContext *CreateContext (int flags)
+{
+  struct lzwContext *ctx;
+
+  ctx = (struct lzwContext *)calloc(1, sizeof(struct lzwContext));
+
+  if (ctx == NULL)
+    return NULL;
+
+  ctx->kernels = GetKernels ();
+  ctx->flags = flags;
+  ctx->encode_block = (flags & FAST_MODE) ? ctx->kernels->encode_block_fast : ctx->kernels->encode_block;
+  ctx->frameCodes = (uint16_t *)malloc(MAX_CODES(FRAME_SIZE) * sizeof(uint16_t));
+  ctx->outline = (uint8_t *)malloc(FRAME_BOUND(FRAME_SIZE));
+
+  if (!InitEncodeState (&ctx->es, flags) || !ctx->frameCodes || !ctx->outline)
+  {
+    FreeContext (ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+/*--------------------------------------------------------------------*/
+
+void FreeContext (struct lzwContext *ctx)
+{
+  if (ctx == NULL)
+    return;
+
+  FreeEncodeState (&ctx->es);
+  free (ctx->frameCodes);
+  free (ctx->outline);
+  free (ctx->codes);
+  free (ctx);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t CompressBound (size_t size)
+{
+  size_t frames = size / FRAME_SIZE, rest = size % FRAME_SIZE;
+  size_t blocks = (size + BUFFLEN - 1) / BUFFLEN;
+  size_t framed = frames * FRAME_BOUND(FRAME_SIZE) + (rest ? FRAME_BOUND(rest) : 0);
+  size_t stream = PACKED_SIZE(MAX_CODES(size + blocks));   /* one more code per block */
+
+  return HEADER_SIZE + ((framed > stream) ? framed : stream);
+}
+
+/*--------------------------------------------------------------------*/
+/* Version 0 or CONTINUOUS_VERSION layout, same as PackStream in
+   lzw06pack.c. */
+static int CompressStream (struct lzwContext *ctx, const uint8_t *src, size_t size,
+                           uint8_t *dst, size_t capacity, size_t *outSize)
+{
+  struct encodeState *es = &ctx->es;
+  uint16_t *codes = ctx->frameCodes;
+  int continuous = (ctx->flags & CONTINUOUS_OUTPUT) ? 1 : 0;
+  size_t step = continuous ? FRAME_SIZE : BUFFLEN;   /* codes[] holds MAX_CODES(FRAME_SIZE) */
+  size_t pos = 0, len, count, carry = 0, pairs;
+
+  ResetEncodeState (es);
+
+  while (true)
+  {
+    len = (size < step) ? size : step;
+    count = carry;
+
+    if (len > 0)
+    {
+      if (!continuous)
+        es->CurCode = NO_PHRASE;
+
+      count += ctx->encode_block (es, src, len, codes + count);
+
+      if (!continuous)
+        codes[count++] = (uint16_t)es->CurCode;
+    }
+    else
+    {
+      if (continuous && es->CurCode != NO_PHRASE)
+        codes[count++] = (uint16_t)es->CurCode;
+
+      codes[count++] = EOF_CODE;
+    }
+
+    pairs = (len > 0) ? (count & ~(size_t)1) : count;
+
+    if (PACKED_SIZE(pairs) > capacity - pos)
+      return 0;
+
+    pos += ctx->kernels->pack_codes (codes, pairs, dst + pos);
+
+    if (len == 0)
+      break;
+
+    carry = count - pairs;
+
+    if (carry)
+      codes[0] = codes[count - 1];
+
+    src += len;
+    size -= len;
+  }
+
+  *outSize = pos;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int CompressFrames (struct lzwContext *ctx, const void *in, size_t size,
+                    void *out, size_t capacity, size_t *outSize)
+{
+  const uint8_t *src = (const uint8_t *)in;
+  uint8_t *dst = (uint8_t *)out;
+  size_t pos = 0, len, record;
+
+  while (size > 0)
+  {
+    len = (size < FRAME_SIZE) ? size : FRAME_SIZE;
+
+    record = EncodeFrame (ctx->kernels, &ctx->es, ctx->flags, src, len, ctx->frameCodes, ctx->outline);
+
+    if (record > capacity - pos)
+      return 0;
+
+    memcpy (dst + pos, ctx->outline, record);
+    pos += record;
+    src += len;
+    size -= len;
+  }
+
+  *outSize = pos;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* Same output as Compress with the context's flags. */
+int CompressBuffer (struct lzwContext *ctx, const void *in, size_t size,
+                    void *out, size_t capacity, size_t *outSize)
+{
+  uint8_t *dst = (uint8_t *)out;
+  int framed = (ctx->flags & BLOCKED_OUTPUT) ? 1 : 0, ok;
+  uint8_t version = PACKER_VERSION;
+
+  if (size > 0xFFFFFFFFUL || capacity < HEADER_SIZE)
+    return 0;
+
+  memcpy (dst, "LZW", 4);
+  if (framed)
+    version = FRAMED_VERSION;
+  else if (ctx->flags & CONTINUOUS_OUTPUT)
+    version = CONTINUOUS_VERSION;
+
+  dst[4] = version;
+  dst[5] = InfoBits ();
+  put_u32 (dst + 6, (uint32_t)size);
+
+  if (framed)
+    ok = CompressFrames (ctx, in, size, dst + HEADER_SIZE, capacity - HEADER_SIZE, outSize);
+  else
+    ok = CompressStream (ctx, (const uint8_t *)in, size, dst + HEADER_SIZE, capacity - HEADER_SIZE, outSize);
+
+  if (!ok)
+    return 0;
+
+  *outSize += HEADER_SIZE;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int ReserveCodes (struct lzwContext *ctx, size_t len)
+{
+  size_t need = UNPACKED_COUNT(len);
+
+  if (need > ctx->codesCap)
+  {
+    free (ctx->codes);
+    ctx->codes = (uint16_t *)malloc(need * sizeof(uint16_t));
+    ctx->codesCap = ctx->codes ? need : 0;
+  }
+
+  return (need == 0 || ctx->codes != NULL) ? 1 : 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int DecompressedSize (const void *in, size_t size, size_t *outSize)
+{
+  struct lzwHeader hdr;
+
+  if (!ParseHeader ((const uint8_t *)in, size, &hdr))
+    return 0;
+
+  *outSize = hdr.inputSize;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int DecompressBuffer (struct lzwContext *ctx, const void *in, size_t size,
+                      void *out, size_t capacity, size_t *outSize)
+{
+  const uint8_t *src = (const uint8_t *)in;
+  uint8_t *dst = (uint8_t *)out;
+  struct lzwHeader hdr;
+  size_t pos = HEADER_SIZE, produced = 0;
+  uint32_t rawSize, packedSize;
+
+  if (!ParseHeader (src, size, &hdr) || hdr.inputSize > capacity)
+    return 0;
+
+  if (hdr.version != FRAMED_VERSION && hdr.version != DEDUP_VERSION)
+  {
+    if (!ReserveCodes (ctx, size - pos))
+      return 0;
+
+    if (!DecodeCodes (ctx->kernels, &ctx->uh, src + pos, size - pos, ctx->codes,
+                      dst, hdr.inputSize, (hdr.version == PACKER_VERSION) ? BUFFLEN : 0))
+      return 0;
+
+    produced = hdr.inputSize;
+  }
+  else
+  {
+    while (pos < size)
+    {
+      if (size - pos < FRAME_HEADER_SIZE)
+        return 0;
+
+      rawSize = get_u32 (src + pos);
+      packedSize = get_u32 (src + pos + 4);
+      pos += FRAME_HEADER_SIZE;
+
+      /* a copy of earlier output */
+      if (hdr.version == DEDUP_VERSION && packedSize == REFERENCE_FRAME)
+      {
+        if (size - pos < REFERENCE_SIZE || get_u32 (src + pos) > produced
+            || rawSize > produced - get_u32 (src + pos) || rawSize > hdr.inputSize - produced)
+          return 0;
+
+        memcpy (dst + produced, dst + get_u32 (src + pos), rawSize);
+        pos += REFERENCE_SIZE;
+        produced += rawSize;
+        continue;
+      }
+
+      if (packedSize > size - pos || packedSize > FRAME_BOUND(rawSize)
+          || rawSize > hdr.inputSize - produced)
+        return 0;
+
+      if (!ReserveCodes (ctx, packedSize))
+        return 0;
+
+      if (!DecodeCodes (ctx->kernels, &ctx->uh, src + pos, packedSize, ctx->codes,
+                        dst + produced, rawSize, 0))
+        return 0;
+
+      pos += packedSize;
+      produced += rawSize;
+    }
+
+    if (produced != hdr.inputSize)
+      return 0;
+  }
+
+  *outSize = produced;
+
+  return 1;
+}
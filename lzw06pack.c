@@ -1,302 +1,1025 @@
-/* This code is based on Mark Nelson's 1995 book. */
-
-/* MY ORIGINAL 1996 COMMENT:  */
-
-/*************************************************/
-/*   Программа упаковщика для алгоритма LZW      */
-/*   полная очистка словаря при заполнении       */
-/*   длина выходных кодов постоянна (12 бит)     */
-/*************************************************/
-
-/* TRANSLATION: */
-
-/**************************************************/
-/*  LZW compression program with full dictionary  */
-/*  reset when filled up. Constant 12-bit codes   */ 
-/*  in output.                                    */   
-/**************************************************/
-
-#include "common.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-
-#include <stdint.h>
-
-#define HT_GET_KEY(l)   (l >> 12)
-#define HT_GET_CODE(l)  (l & 0x0FFF)
-#define HT_PUT_KEY(l)   (l << 12)
-#define HT_PUT_CODE(l)  (l & 0x0FFF)
-
-struct packHelper {
-  uint32_t *table ;
-  uint8_t outline[OUTLEN];
-
-  FILE *fp ;
-  FILE *fout ;
-
-  int bpos;
-  size_t len;
-} ;
-
-static void initializeHelper (struct packHelper *ph)
-{
-  ph->table = NULL;
-  ph->fp = NULL;
-  ph->fout = NULL;
-  ph->bpos = 0;
-  ph->len = 0;
-  memset(ph->outline, 0, OUTLEN);
-}
-/*------------------------------------*/
-static void ClearHashTable(struct packHelper *ph)
-{
-  memset(ph->table, 0xFF, HT_SIZE * sizeof(uint32_t));
-}
-/*-----------------------------------*/
-static void DeleteHashTable (struct packHelper *ph)
-{
-  free (ph->table);
-  ph->table = NULL;
-}
-/*-----------------------------------*/
-static int OutCode (const int16_t code, struct packHelper *ph)
-{
-  if (ph->bpos == 0)
-  {
-    *(uint16_t *)(ph->outline + ph->len++) = code; /* assuming little endian */
-
-    ph->bpos = 4;
-
-    if (code == EOF_CODE)
-    {
-      size_t written = fwrite(ph->outline, 1, ph->len + 1, ph->fout);
-      if (written != ph->len + 1) 
-      {
-        fprintf (stderr, "Write error. Out of disk space? \n");
-        return 0;
-      }
-    }
-  }
-  else
-  {
-    *(uint16_t *)(ph->outline + ph->len) |= (code << 4); /* assuming little endian */
-
-    ph->len += 2;
-    
-    ph->bpos = 0;
-
-    if (ph->len == OUTLEN || code == EOF_CODE)
-    {
-      size_t written = fwrite(ph->outline, 1, ph->len, ph->fout);
-      
-      if (written != ph->len) 
-      {
-        fprintf (stderr, "Write error. Out of disk space? \n");
-        return 0;
-      }
-
-      ph->len = 0;
-
-      memset(ph->outline, 0, OUTLEN);
-    }
-  }
-
-  return 1;
-}
-/*-----------------------------------*/
-static int InitHashTable(struct packHelper *ph)
-{
-  ph->table = (uint32_t *)malloc(HT_SIZE * sizeof(uint32_t));
-
-  if (ph->table == NULL)
-    return 0;
-  
-  ClearHashTable(ph);
-  
-  return 1;
-}
-/*------------------------------------*/
-static int16_t KeyItem (const uint16_t Item)
-{
-  return ((Item >> 12) ^ Item) & HT_KEY_MASK;
-}
-/*-------------------------------------*/
-static void InsertHashTable (const uint32_t Key, int16_t Code, struct packHelper *ph)
-{
-  int HKey = KeyItem(Key);
-
-  while (HT_GET_KEY(ph->table[HKey]) != 0xFFFFFL)
-    HKey = (HKey + 1) & HT_KEY_MASK;
-  
-  ph->table[HKey] = HT_PUT_KEY(Key) | HT_PUT_CODE(Code);
-}
-/*--------------------------------------------*/
-static int ExistHashTable (const uint32_t Key, struct packHelper *ph)
-{
-  int16_t HKey = KeyItem(Key);
-  uint32_t HTKey;
-
-  while ((HTKey = HT_GET_KEY(ph->table[HKey])) != 0xFFFFFL)
-  {
-    if (Key == HTKey)
-      return HT_GET_CODE(ph->table[HKey]);
-  
-    HKey = (HKey + 1) & HT_KEY_MASK;
-  }
-  
-  return -1;
-}
-/*-------------------------------------------------*/
-int Compress(const char *filename, const char *outfile, int flags)
-{
-  uint8_t *buffer;
-  int16_t CurCode, RunCode = 256, NewCode;
-  uint32_t NewKey;
-  int len, i;
-  const char label[4] = "LZW";
-  const uint8_t version = PACKER_VERSION;
-  uint8_t infoBits = 0;
-  uint32_t inputSize = 0, outputSize = 0;
-  int compress_ok = true;
-  struct packHelper ph;
-
-  if (is_big_endian())
-  {
-    fprintf (stderr, "Not supported on big endian machines.\n");
-    return 0;
-  }
-
-  initializeHelper (&ph);
-
-  ph.fp = fopen(filename, "rb");
-
-  if (NULL == ph.fp)
-  {
-    fprintf (stderr, "Cannot open input file \'%s\'.\n", filename);
-    perror (NULL);
-    return 0;
-  }
-
-  ph.fout = fopen (outfile, "wb");
-
-  if (NULL == ph.fout)
-  {
-    fprintf (stderr, "Cannot open output file \'%s\'.\n", outfile);
-    perror (NULL);
-    fclose (ph.fp);
-    return 0;
-  }
-
-  if (!InitHashTable(&ph))
-  {
-    perror(NULL);
-    fclose (ph.fp);
-    fclose (ph.fout);
-    cleanup (outfile, flags);
-    return 0;
-  }
-
-  buffer = (unsigned char *)malloc(BUFFLEN);
-  
-  if (!buffer)
-  {
-    fclose (ph.fp);
-    fclose (ph.fout);
-    perror (NULL);
-    DeleteHashTable(&ph);
-    cleanup (outfile, flags);
-    return 0;
-  }
-
-  fwrite(label, 1, 4, ph.fout);
-
-  fwrite (&version, 1, 1, ph.fout);
-
-  infoBits |= (is_big_endian() ? 1 : 0);
-  infoBits |= VARIABLE_WIDTH ? 2 : 0;
-
-  /* leaving 2 bits reserved. */
-  infoBits |= ((MAX_BITS - 8) << 4); /* we use left 4 bits for MAX_BITS information; can be between 8 and 23. */
-
-  fwrite (&infoBits, 1, 1, ph.fout);
-
-  /* write size of input file. */
-  fseek (ph.fp, 0, SEEK_END);
-  inputSize = ftell (ph.fp);
-  fseek (ph.fp, 0, SEEK_SET);
-
-  fwrite (&inputSize, 1, sizeof(uint32_t), ph.fout);
-
-  while (compress_ok)
-  {
-    len = (int)fread(buffer, 1, BUFFLEN, ph.fp);
-
-    if (len == 0)
-      break;
-    
-    CurCode = *buffer;
-
-    for (i = 1; i < len; i++)
-    {
-      NewKey = (((uint32_t)CurCode) << 8) + buffer[i];
-
-      if ((NewCode = ExistHashTable(NewKey, &ph)) >= 0)
-      {
-        CurCode = NewCode;
-      }
-      else
-      {
-        if (!OutCode (CurCode, &ph))
-        {
-          compress_ok = false;
-          break;
-        }
-
-        CurCode = buffer[i];
-        if (RunCode == HT_CLEAR_CODE)
-        {
-          ClearHashTable(&ph);
-          RunCode = 256;
-          if (!OutCode (HT_CLEAR_CODE, &ph))
-          {
-            compress_ok = false;
-            break;
-          }
-        }
-        else
-        {
-          InsertHashTable (NewKey, RunCode++, &ph);
-        }
-      }
-    }
-
-    if (!OutCode (CurCode, &ph))
-      compress_ok = false;
-  }
-
-  if (compress_ok)
-    OutCode (EOF_CODE, &ph);
-
-  DeleteHashTable(&ph);
-
-  free(buffer);
-
-  outputSize = ftell (ph.fout);
-
-  fclose(ph.fp);
-  fclose (ph.fout);
-
-  if (!compress_ok)
-  {
-    cleanup (outfile, flags);
-  }
-
-  if (compress_ok && (VERBOSE_OUTPUT & flags))
-  {
-    printf ("Compression ratio %.2f%%\n", 100.0 * (inputSize - outputSize) / inputSize );
-  }
-
-  return compress_ok ? 1 : 0;
-}
+/* This code is based on Mark Nelson's 1995 book. */
+
+/* MY ORIGINAL 1996 COMMENT:  */
+
+/*************************************************/
+/*   Программа упаковщика для алгоритма LZW      */
+/*   полная очистка словаря при заполнении       */
+/*   длина выходных кодов постоянна (12 бит)     */
+/*************************************************/
+
+/* TRANSLATION: */
+
+/**************************************************/
+/*  LZW compression program with full dictionary  */
+/*  reset when filled up. Constant 12-bit codes   */ 
+/*  in output.                                    */   
+/**************************************************/
+
+#define _GNU_SOURCE /* SEEK_DATA, SEEK_HOLE */
+
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "codec.h"
+
+/* codes for len input bytes read at once: every version 0 block adds its
+   closing code and every reset policy window possibly an HT_CLEAR_CODE,
+   besides the ones the dictionary fills produce; plus the carried code */
+#define STREAM_CODES(len)   (MAX_CODES(len) + 2 * ((len) / RESET_WINDOW + 2))
+
+#define CHECKPOINT_INTERVAL  (64UL << 20)   /* default input bytes between checkpoints */
+#define NO_CODE              (-1)
+
+/* RESUMABLE_OUTPUT: where packing can start again. Every HT_CLEAR_CODE
+   leaves the encoder with an empty dictionary, so the input offset after
+   it, the output bytes of the complete code pairs before it and whether
+   the clear code itself is still waiting for its pair (the bit phase) are
+   all there is to it. Framed files use frame boundaries instead. */
+struct checkpoint
+{
+  int version;
+  int fast;
+  int policy;   /* LZW_RESET_... */
+  unsigned long inputSize;
+  unsigned long inputOffset;
+  unsigned long outputOffset;
+  int carry;    /* HT_CLEAR_CODE not written yet */
+};
+
+struct packHelper {
+  struct encodeState es;
+  const struct lzwKernels *kernels;
+  encodeBlockFn encode_block;
+
+  uint16_t *codes;   /* codes[0] may hold a code carried over from the previous block */
+  uint8_t *outline;
+
+  FILE *fp ;
+  FILE *fout ;
+
+  size_t carry;      /* 1 if codes[0] is waiting for its pair */
+
+  struct progressState progress;
+  unsigned long bytesRead, bytesWritten;
+
+  long inputSize, readPos;
+  long holeStart, holeEnd;   /* next hole in the input at or after readPos */
+
+  struct resetMonitor monitor;
+  int monitoring;            /* a reset policy is used or its stats are wanted */
+
+  /* RESUMABLE_OUTPUT */
+  char *checkpointFile;      /* NULL if not resumable */
+  struct checkpoint last;
+  unsigned long checkpointInterval;
+  unsigned long codeTotal;   /* codes so far, the carried one included */
+  unsigned long clearInput, clearCodes;  /* latest clear code: input after it, codes up to it */
+} ;
+
+static void initializeHelper (struct packHelper *ph, int flags)
+{
+  ph->es.table = NULL;
+  ph->kernels = GetKernels ();
+  ph->encode_block = (flags & FAST_MODE) ? ph->kernels->encode_block_fast : ph->kernels->encode_block;
+  ph->codes = NULL;
+  ph->outline = NULL;
+  ph->fp = NULL;
+  ph->fout = NULL;
+  ph->carry = 0;
+  ph->bytesRead = 0;
+  ph->bytesWritten = HEADER_SIZE;
+  ph->inputSize = ph->readPos = 0;
+  ph->holeStart = ph->holeEnd = 0;
+  InitResetMonitor (&ph->monitor, LZW_RESET_FULL);
+  ph->monitoring = 0;
+  ph->checkpointFile = NULL;
+  ph->checkpointInterval = CHECKPOINT_INTERVAL;
+  ph->codeTotal = 0;
+  ph->clearInput = ph->clearCodes = 0;
+  memset (&ph->last, 0, sizeof(ph->last));
+}
+/*------------------------------------*/
+static void NextHole (struct packHelper *ph)
+{
+#if defined(SEEK_HOLE) && defined(SEEK_DATA)
+  int fd = fileno (ph->fp);
+  off_t hole = lseek (fd, ph->readPos, SEEK_HOLE), data;
+
+  if (hole < 0 || hole > ph->inputSize)
+    hole = ph->inputSize;
+
+  data = (hole < ph->inputSize) ? lseek (fd, hole, SEEK_DATA) : hole;
+
+  /* no more data after the hole */
+  if (data < 0 || data > ph->inputSize)
+    data = ph->inputSize;
+
+  ph->holeStart = hole;
+  ph->holeEnd = data;
+
+  /* lseek moved the descriptor under the stream */
+  fseek (ph->fp, ph->readPos, SEEK_SET);
+#else
+  ph->holeStart = ph->holeEnd = ph->inputSize;
+#endif
+}
+/*------------------------------------*/
+/* fread of the input, except that holes in a sparse file are zero filled
+   instead of read */
+static size_t ReadInput (struct packHelper *ph, uint8_t *buffer, size_t len)
+{
+  size_t done = 0, n;
+
+  while (done < len && ph->readPos < ph->inputSize)
+  {
+    if (ph->readPos >= ph->holeEnd)
+      NextHole (ph);
+
+    if (ph->readPos < ph->holeStart)
+    {
+      n = len - done;
+
+      if ((long)n > ph->holeStart - ph->readPos)
+        n = ph->holeStart - ph->readPos;
+
+      if (0 == (n = fread (buffer + done, 1, n, ph->fp)))
+        break;
+    }
+    else
+    {
+      n = len - done;
+
+      if ((long)n > ph->holeEnd - ph->readPos)
+        n = ph->holeEnd - ph->readPos;
+
+      memset (buffer + done, 0, n);
+      fseek (ph->fp, ph->readPos + n, SEEK_SET);
+    }
+
+    ph->readPos += n;
+    done += n;
+  }
+
+  return done;
+}
+/*------------------------------------*/
+/* Input bytes of the codes after the last HT_CLEAR_CODE in codes, plus
+   the open phrase pending (or NO_PHRASE), from the lengths the decoder
+   would give them; *clear gets the index of that clear code. Returns -1
+   if there is none. No version 0 block boundary may lie in between. */
+static long AfterLastClear (const uint16_t *codes, size_t count, int pending, size_t *clear)
+{
+  uint16_t length[HT_MAX_CODE];
+  int RunCode = 256, OldCode = NO_CODE, k;
+  long bytes = 0;
+  size_t i = count;
+
+  while (i > 0 && codes[i - 1] != HT_CLEAR_CODE)
+    i--;
+
+  if (i == 0)
+    return -1;
+
+  *clear = i - 1;
+
+  for (k = 0; k < 256; k++)
+    length[k] = 1;
+
+  for (; i <= count; i++)
+  {
+    k = (i < count) ? codes[i] : pending;
+
+    if (k == NO_PHRASE)
+      break;
+
+    if (OldCode != NO_CODE && RunCode < HT_CLEAR_CODE)
+      length[RunCode++] = length[OldCode] + 1;
+
+    bytes += length[k];
+    OldCode = k;
+  }
+
+  return bytes;
+}
+/*------------------------------------*/
+/* notes the last clear code among the count codes at ph->codes + first,
+   which cover the input up to end */
+static void NoteClear (struct packHelper *ph, size_t first, size_t count, int pending, unsigned long end)
+{
+  size_t clear;
+  long after = AfterLastClear (ph->codes + first, count, pending, &clear);
+
+  if (after >= 0)
+  {
+    ph->clearInput = end - after;
+    ph->clearCodes = ph->codeTotal - ph->carry + first + clear + 1;
+  }
+}
+/*------------------------------------*/
+
+static int LoadCheckpoint (const char *name, struct checkpoint *c)
+{
+  FILE *fp = fopen (name, "r");
+  int ok;
+
+  if (fp == NULL)
+    return 0;
+
+  ok = (7 == fscanf (fp, "lzw06 checkpoint %d %d %d %lu %lu %lu %d", &c->version, &c->fast, &c->policy,
+                     &c->inputSize, &c->inputOffset, &c->outputOffset, &c->carry));
+  fclose (fp);
+
+  return ok;
+}
+/*------------------------------------*/
+/* Makes the output durable up to the checkpoint first, then replaces the
+   checkpoint file in one rename, so a crash leaves the old or the new one. */
+static int SaveCheckpoint (struct packHelper *ph, unsigned long inputOffset,
+                           unsigned long outputOffset, int carry)
+{
+  size_t len = strlen (ph->checkpointFile);
+  char *temp = (char *)malloc(len + 5);
+  FILE *fp;
+  int ok;
+
+  if (temp == NULL || !sync_file (ph->fout))
+  {
+    free (temp);
+    return 0;
+  }
+
+  sprintf (temp, "%s.tmp", ph->checkpointFile);
+
+  ok = (NULL != (fp = fopen (temp, "w")));
+  ok = ok && fprintf (fp, "lzw06 checkpoint %d %d %d %lu %lu %lu %d\n", ph->last.version, ph->last.fast,
+                      ph->last.policy, ph->last.inputSize, inputOffset, outputOffset, carry) > 0;
+  ok = ok && sync_file (fp);
+
+  if (fp != NULL && EOF == fclose (fp))
+    ok = false;
+
+#if defined(_WIN32)
+  remove (ph->checkpointFile);
+#endif
+
+  ok = ok && (0 == rename (temp, ph->checkpointFile));
+
+  if (ok)
+  {
+    ph->last.inputOffset = inputOffset;
+    ph->last.outputOffset = outputOffset;
+    ph->last.carry = carry;
+  }
+  else
+  {
+    remove (temp);
+    fprintf (stderr, "Cannot write checkpoint '%s'.\n", ph->checkpointFile);
+  }
+
+  free (temp);
+  return ok;
+}
+/*------------------------------------*/
+/* checkpoint at the latest clear code if the interval has passed */
+static int StreamCheckpoint (struct packHelper *ph)
+{
+  if (ph->checkpointFile == NULL || ph->clearInput < ph->last.inputOffset + ph->checkpointInterval)
+    return 1;
+
+  return SaveCheckpoint (ph, ph->clearInput, HEADER_SIZE + PACKED_SIZE(ph->clearCodes & ~1UL),
+                         (int)(ph->clearCodes & 1));
+}
+/*------------------------------------*/
+void ClearHashTable(uint32_t *table, size_t size)
+{
+  memset(table, 0xFF, size * sizeof(uint32_t));
+}
+/*------------------------------------*/
+int InitEncodeState (struct encodeState *es, int flags)
+{
+  es->tableSize = (flags & FAST_MODE) ? FAST_HT_SIZE : HT_SIZE;
+  es->table = (uint32_t *)malloc(es->tableSize * sizeof(uint32_t));
+
+  if (es->table == NULL)
+    return 0;
+
+  es->freeze = 0;
+  ResetEncodeState (es);
+
+  return 1;
+}
+/*------------------------------------*/
+void ResetEncodeState (struct encodeState *es)
+{
+  ClearHashTable (es->table, es->tableSize);
+  es->RunCode = 256;
+  es->CurCode = NO_PHRASE;
+}
+/*------------------------------------*/
+void FreeEncodeState (struct encodeState *es)
+{
+  free (es->table);
+  es->table = NULL;
+}
+/*-----------------------------------*/
+static void DeleteHelper (struct packHelper *ph)
+{
+  FreeEncodeState (&ph->es);
+  free (ph->codes);
+  free (ph->outline);
+  ph->codes = NULL;
+  ph->outline = NULL;
+}
+/*-----------------------------------*/
+/* Packs and writes count codes starting at ph->codes. Codes go out in
+   pairs, so an odd one is kept back unless this is the end of stream. */
+static int OutCodes (size_t count, int final, struct packHelper *ph)
+{
+  size_t pairs = final ? count : (count & ~(size_t)1);
+  size_t len = ph->kernels->pack_codes (ph->codes, pairs, ph->outline);
+
+  if (len != fwrite(ph->outline, 1, len, ph->fout))
+  {
+    fprintf (stderr, "Write error. Out of disk space? \n");
+    return 0;
+  }
+
+  ph->bytesWritten += len;
+  ph->carry = count - pairs;
+
+  if (ph->carry)
+    ph->codes[0] = ph->codes[count - 1];
+
+  return 1;
+}
+/*-----------------------------------*/
+static int InitHelper(struct packHelper *ph, int flags, size_t bufferSize)
+{
+  ph->codes = (uint16_t *)malloc(STREAM_CODES(bufferSize) * sizeof(uint16_t));
+  ph->outline = (uint8_t *)malloc(PACKED_SIZE(STREAM_CODES(bufferSize)));
+
+  if (!InitEncodeState (&ph->es, flags) || ph->codes == NULL || ph->outline == NULL)
+  {
+    DeleteHelper (ph);
+    return 0;
+  }
+
+  return 1;
+}
+/*-------------------------------------------------*/
+/* Reset policy bookkeeping for the codes from first to count, which
+   packed the input up to end; full if the dictionary was full before.
+   Where a window ends the policy may clear the dictionary, after the
+   open phrase is written. Returns the new count. */
+static size_t CheckReset (struct packHelper *ph, size_t first, size_t count,
+                          unsigned long end, size_t bytes, int full)
+{
+  size_t k;
+
+  MonitorBlock (&ph->monitor, bytes, count - first, full);
+
+  if (ph->monitor.policy == LZW_RESET_FULL)
+  {
+    for (k = first; k < count; k++)
+    {
+      if (ph->codes[k] == HT_CLEAR_CODE)
+        MonitorClear (&ph->monitor);
+    }
+  }
+  else if (end % RESET_WINDOW == 0 && WantReset (&ph->monitor, ph->es.RunCode == HT_CLEAR_CODE))
+  {
+    if (ph->es.CurCode != NO_PHRASE)
+      ph->codes[count++] = (uint16_t)ph->es.CurCode;
+
+    ph->codes[count++] = HT_CLEAR_CODE;
+    ResetEncodeState (&ph->es);
+  }
+
+  return count;
+}
+/*-------------------------------------------------*/
+/* Version 0 stream: one dictionary for the whole file, a new phrase
+   at every BUFFLEN block. CONTINUOUS_VERSION: the same without the
+   blocks. bufferSize is only the read size; for version 0 it is rounded
+   to whole blocks. */
+static int PackStream (struct packHelper *ph, int flags, size_t bufferSize)
+{
+  uint8_t *buffer;
+  size_t len, want, count, pos, block, first;
+  size_t window = (ph->monitor.policy == LZW_RESET_FULL) ? BUFFLEN : RESET_WINDOW;
+  unsigned long start, end;
+  int compress_ok = true, continuous = (flags & CONTINUOUS_OUTPUT) ? 1 : 0, full;
+
+  if (!continuous)
+    bufferSize = (bufferSize < BUFFLEN) ? BUFFLEN : bufferSize - bufferSize % BUFFLEN;
+
+  buffer = (unsigned char *)malloc(bufferSize);
+
+  if (!buffer || !InitHelper(ph, flags, bufferSize))
+  {
+    perror (NULL);
+    free (buffer);
+    return 0;
+  }
+
+  /* resumed after a clear code that still waits for its pair */
+  if (ph->carry)
+    ph->codes[0] = HT_CLEAR_CODE;
+
+  ph->es.freeze = (ph->monitor.policy != LZW_RESET_FULL);
+
+  while (compress_ok)
+  {
+    /* a resumed version 0 stream may start inside a block */
+    start = ph->readPos;
+    want = bufferSize - (continuous ? 0 : start % BUFFLEN);
+    len = ReadInput (ph, buffer, want);
+
+    if (len == 0)
+      break;
+
+    count = ph->carry;
+
+    /* version 0 blocks, or windows of the reset policy */
+    for (pos = 0; pos < len; pos += block)
+    {
+      block = window - (start + pos) % window;
+
+      if (block > len - pos)
+        block = len - pos;
+
+      /* every block starts a new phrase */
+      if (!continuous && (start + pos) % BUFFLEN == 0)
+        ph->es.CurCode = NO_PHRASE;
+
+      full = (ph->es.RunCode == HT_CLEAR_CODE);
+      first = count;
+      count += ph->encode_block (&ph->es, buffer + pos, block, ph->codes + count);
+      end = start + pos + block;
+
+      /* and is closed at its end, or where the input ends */
+      if (!continuous && (end % BUFFLEN == 0 || (pos + block == len && len < want)))
+      {
+        ph->codes[count++] = (uint16_t)ph->es.CurCode;
+        ph->es.CurCode = NO_PHRASE;
+      }
+
+      if (ph->monitoring)
+        count = CheckReset (ph, first, count, end, block, full);
+
+      if (ph->checkpointFile)
+        NoteClear (ph, first, count - first, ph->es.CurCode, end);
+    }
+
+    ph->bytesRead += len;
+    ph->codeTotal += count - ph->carry;
+
+    if (!OutCodes (count, false, ph) || !StreamCheckpoint (ph) ||
+        !UpdateProgress (&ph->progress, ph->bytesRead, ph->bytesWritten))
+      compress_ok = false;
+  }
+
+  if (compress_ok)
+  {
+    count = ph->carry;
+
+    if (ph->es.CurCode != NO_PHRASE)
+      ph->codes[count++] = (uint16_t)ph->es.CurCode;
+
+    ph->codes[count++] = EOF_CODE;
+    compress_ok = OutCodes (count, true, ph);
+  }
+
+  DeleteHelper(ph);
+
+  free(buffer);
+
+  return compress_ok;
+}
+/*-------------------------------------------------*/
+/* Closes the phrase left open by the kernel and packs the frame record. */
+static size_t FinishFrame (const struct lzwKernels *k, struct encodeState *es,
+                           size_t len, uint16_t *codes, size_t count, uint8_t *out)
+{
+  size_t packed;
+
+  if (len != 0)
+    codes[count++] = (uint16_t)es->CurCode;
+
+  codes[count++] = EOF_CODE;
+
+  packed = k->pack_codes (codes, count, out + FRAME_HEADER_SIZE);
+
+  put_u32 (out, (uint32_t)len);
+  put_u32 (out + 4, (uint32_t)packed);
+
+  return FRAME_HEADER_SIZE + packed;
+}
+/*-------------------------------------------------*/
+size_t EncodeFrame (const struct lzwKernels *k, struct encodeState *es, int flags,
+                    const uint8_t *in, size_t len, uint16_t *codes, uint8_t *out)
+{
+  size_t count;
+
+  ResetEncodeState (es);
+
+  if (flags & FAST_MODE)
+    count = k->encode_block_fast (es, in, len, codes);
+  else
+    count = k->encode_block (es, in, len, codes);
+
+  return FinishFrame (k, es, len, codes, count, out);
+}
+/*-------------------------------------------------*/
+/* Framed stream (FRAMED_VERSION): the input is cut into FRAME_SIZE frames,
+   each with its own dictionary and terminated by EOF_CODE, written as
+   rawSize, packedSize, packed codes. */
+static int PackFrames (struct packHelper *ph, int flags)
+{
+  struct encodeState es;
+  uint16_t *codes = (uint16_t *)malloc(MAX_CODES(FRAME_SIZE) * sizeof(uint16_t));
+  uint8_t *buffer = (uint8_t *)malloc(FRAME_SIZE), *outline = (uint8_t *)malloc(FRAME_BOUND(FRAME_SIZE));
+  size_t len, size;
+  int compress_ok = InitEncodeState (&es, flags) && codes && buffer && outline;
+
+  if (!compress_ok)
+    perror (NULL);
+
+  while (compress_ok)
+  {
+    len = ReadInput (ph, buffer, FRAME_SIZE);
+
+    if (len == 0)
+      break;
+
+    ph->bytesRead += len;
+
+    size = EncodeFrame (ph->kernels, &es, flags, buffer, len, codes, outline);
+
+    if (size != fwrite(outline, 1, size, ph->fout))
+    {
+      fprintf (stderr, "Write error. Out of disk space? \n");
+      compress_ok = false;
+    }
+
+    ph->bytesWritten += size;
+
+    /* every frame starts from an empty dictionary */
+    if (compress_ok && ph->checkpointFile &&
+        (unsigned long)ph->readPos >= ph->last.inputOffset + ph->checkpointInterval)
+      compress_ok = SaveCheckpoint (ph, ph->readPos, ph->bytesWritten, 0);
+
+    if (compress_ok && !UpdateProgress (&ph->progress, ph->bytesRead, ph->bytesWritten))
+      compress_ok = false;
+  }
+
+  FreeEncodeState (&es);
+  free (codes);
+  free (buffer);
+  free (outline);
+
+  return compress_ok;
+}
+/*-------------------------------------------------*/
+#define DEDUP_BUFFER   (16 * CHUNK_MAX)
+
+static int WriteRecord (struct packHelper *ph, const uint8_t *record, size_t size)
+{
+  if (size != fwrite(record, 1, size, ph->fout))
+  {
+    fprintf (stderr, "Write error. Out of disk space? \n");
+    return 0;
+  }
+
+  ph->bytesWritten += size;
+
+  return 1;
+}
+/*-------------------------------------------------*/
+/* Whether the len bytes at data are the input at offset; base is the
+   input offset of buffer, which still holds what comes after it. */
+static int SameInput (struct packHelper *ph, uint32_t offset, const uint8_t *data, size_t len,
+                      const uint8_t *buffer, unsigned long base, uint8_t *scratch)
+{
+  int same;
+
+  if (offset >= base)
+    return 0 == memcmp (buffer + (offset - base), data, len);
+
+  /* ReadInput carries on from readPos */
+  same = 0 == fseek (ph->fp, (long)offset, SEEK_SET) &&
+         len == fread (scratch, 1, len, ph->fp) && 0 == memcmp (scratch, data, len);
+
+  return (0 == fseek (ph->fp, ph->readPos, SEEK_SET)) && same;
+}
+/*-------------------------------------------------*/
+/* Deduplicated stream (DEDUP_VERSION): the input is cut into chunks by
+   content (dedup.c). A chunk seen before, byte for byte, becomes a
+   reference frame; the others are frames as in PackFrames. */
+static int PackDedup (struct packHelper *ph, int flags)
+{
+  struct encodeState es;
+  struct chunkIndex idx;
+  const struct chunkEntry *e;
+  uint8_t *buffer = (uint8_t *)malloc(DEDUP_BUFFER), *scratch = (uint8_t *)malloc(CHUNK_MAX);
+  uint8_t *outline = (uint8_t *)malloc(FRAME_BOUND(CHUNK_MAX));
+  uint16_t *codes = (uint16_t *)malloc(MAX_CODES(CHUNK_MAX) * sizeof(uint16_t));
+  uint8_t ref[FRAME_HEADER_SIZE + REFERENCE_SIZE];
+  unsigned long base = 0;   /* input offset of buffer[0] */
+  unsigned long chunks = 0, duplicates = 0, saved = 0;
+  size_t have = 0, pos, len;
+  uint64_t hash;
+  int last = false, compress_ok = InitEncodeState (&es, flags);
+
+  compress_ok = InitChunkIndex (&idx) && compress_ok && buffer && scratch && outline && codes;
+
+  if (!compress_ok)
+    perror (NULL);
+
+  while (compress_ok && !last)
+  {
+    len = ReadInput (ph, buffer + have, DEDUP_BUFFER - have);
+    last = (have + len < DEDUP_BUFFER);
+    have += len;
+    ph->bytesRead += len;
+
+    for (pos = 0; compress_ok && pos < have; pos += len)
+    {
+      if (0 == (len = NextChunk (&idx, buffer + pos, have - pos, last)))
+        break;
+
+      hash = ChunkHash (buffer + pos, len);
+      e = FindChunk (&idx, hash, (uint32_t)len);
+      chunks++;
+
+      if (e && SameInput (ph, e->offset, buffer + pos, len, buffer, base, scratch))
+      {
+        put_u32 (ref, (uint32_t)len);
+        put_u32 (ref + 4, REFERENCE_FRAME);
+        put_u32 (ref + 8, e->offset);
+        compress_ok = WriteRecord (ph, ref, sizeof(ref));
+        duplicates++;
+        saved += len;
+      }
+      else
+      {
+        /* a fingerprint collision keeps the first chunk */
+        compress_ok = AddChunk (&idx, hash, (uint32_t)(base + pos), (uint32_t)len) &&
+                      WriteRecord (ph, outline, EncodeFrame (ph->kernels, &es, flags, buffer + pos, len, codes, outline));
+      }
+    }
+
+    if (compress_ok)
+      compress_ok = UpdateProgress (&ph->progress, ph->bytesRead, ph->bytesWritten);
+
+    /* the rest moves to the front for the next read */
+    memmove (buffer, buffer + pos, have - pos);
+    base += pos;
+    have -= pos;
+  }
+
+  if (compress_ok && (VERBOSE_OUTPUT & flags))
+    printf ("Duplicate chunks: %lu of %lu, %lu bytes.\n", duplicates, chunks, saved);
+
+  FreeEncodeState (&es);
+  FreeChunkIndex (&idx);
+  free (buffer);
+  free (scratch);
+  free (outline);
+  free (codes);
+
+  return compress_ok;
+}
+/*-------------------------------------------------*/
+int Compress(const char *filename, const char *outfile, int flags)
+{
+  struct lzwOptions options;
+
+  memset (&options, 0, sizeof(options));
+  options.flags = flags;
+
+  return CompressEx (filename, outfile, &options);
+}
+/*-------------------------------------------------*/
+/* RESUMABLE_OUTPUT: names the checkpoint file and returns 1 if it holds
+   a checkpoint of this job to resume from, 0 to start over, -1 on error. */
+static int FindCheckpoint (struct packHelper *ph, const char *outfile, int version, int flags)
+{
+  struct checkpoint c;
+  FILE *fp;
+  long size = -1;
+
+  if (NULL == (ph->checkpointFile = (char *)malloc(strlen (outfile) + 6)))
+    return -1;
+
+  sprintf (ph->checkpointFile, "%s.ckpt", outfile);
+
+  ph->last.version = version;
+  ph->last.fast = (flags & FAST_MODE) ? 1 : 0;
+  ph->last.policy = ph->monitor.policy;
+  ph->last.inputSize = (unsigned long)ph->inputSize;
+
+  if (!LoadCheckpoint (ph->checkpointFile, &c))
+    return 0;
+
+  if (NULL != (fp = fopen (outfile, "rb")))
+  {
+    fseek (fp, 0, SEEK_END);
+    size = ftell (fp);
+    fclose (fp);
+  }
+
+  if (c.version != ph->last.version || c.fast != ph->last.fast || c.policy != ph->last.policy ||
+      c.inputSize != ph->last.inputSize ||
+      c.inputOffset > c.inputSize || size < 0 || (unsigned long)size < c.outputOffset ||
+      c.outputOffset < HEADER_SIZE || (c.carry && version == FRAMED_VERSION))
+  {
+    fprintf (stderr, "Checkpoint '%s' does not match; starting over.\n", ph->checkpointFile);
+    return 0;
+  }
+
+  ph->last = c;
+
+  return 1;
+}
+/*-------------------------------------------------*/
+int CompressEx(const char *filename, const char *outfile, const struct lzwOptions *options)
+{
+  uint32_t inputSize = 0, outputSize = 0;
+  int compress_ok = true, flags = options->flags, resume = 0;
+  uint8_t version = PACKER_VERSION;
+  struct packHelper ph;
+
+  if (is_big_endian())
+  {
+    fprintf (stderr, "Not supported on big endian machines.\n");
+    return 0;
+  }
+
+  initializeHelper (&ph, flags);
+
+  ph.fp = fopen(filename, "rb");
+
+  if (NULL == ph.fp)
+  {
+    fprintf (stderr, "Cannot open input file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  /* write size of input file. */
+  fseek (ph.fp, 0, SEEK_END);
+  ph.inputSize = inputSize = ftell (ph.fp);
+  fseek (ph.fp, 0, SEEK_SET);
+
+  if (flags & DEDUP_OUTPUT)
+    version = DEDUP_VERSION;
+  else if (flags & BLOCKED_OUTPUT)
+    version = FRAMED_VERSION;
+  else if (flags & CONTINUOUS_OUTPUT)
+    version = CONTINUOUS_VERSION;
+
+  if ((flags & DEDUP_OUTPUT) && (flags & RESUMABLE_OUTPUT))
+  {
+    fprintf (stderr, "Deduplicated output cannot be resumed.\n");
+    fclose (ph.fp);
+    return 0;
+  }
+
+  if (options->resetPolicy < LZW_RESET_FULL || options->resetPolicy > LZW_RESET_WINDOW)
+  {
+    fprintf (stderr, "Unknown reset policy %d.\n", options->resetPolicy);
+    fclose (ph.fp);
+    return 0;
+  }
+
+  /* version 0 readers before the table guard in ExpandCode overrun a full
+     table, so only the continuous format may keep one */
+  if (options->resetPolicy != LZW_RESET_FULL && version != CONTINUOUS_VERSION)
+  {
+    fprintf (stderr, "Reset policies other than full need continuous output.\n");
+    fclose (ph.fp);
+    return 0;
+  }
+
+  /* framed files reset at every frame and when full */
+  if (!(flags & (BLOCKED_OUTPUT | DEDUP_OUTPUT)))
+  {
+    InitResetMonitor (&ph.monitor, options->resetPolicy);
+    ph.monitoring = (options->resetPolicy != LZW_RESET_FULL || options->resetStats != NULL
+                     || (flags & VERBOSE_OUTPUT));
+  }
+
+  if ((flags & RESUMABLE_OUTPUT) && (resume = FindCheckpoint (&ph, outfile, version, flags)) < 0)
+  {
+    perror (NULL);
+    fclose (ph.fp);
+    return 0;
+  }
+
+  if (options->checkpointInterval)
+    ph.checkpointInterval = options->checkpointInterval;
+
+  ph.fout = fopen (outfile, resume ? "r+b" : "wb");
+
+  if (NULL == ph.fout)
+  {
+    fprintf (stderr, "Cannot open output file \'%s\'.\n", outfile);
+    perror (NULL);
+    fclose (ph.fp);
+    free (ph.checkpointFile);
+    return 0;
+  }
+
+  InitProgress (&ph.progress, options, inputSize, false);
+
+  if (resume)
+  {
+    /* drop whatever was written after the checkpoint */
+    compress_ok = truncate_file (ph.fout, (long)ph.last.outputOffset) &&
+                  0 == fseek (ph.fout, 0, SEEK_END) &&
+                  0 == fseek (ph.fp, (long)ph.last.inputOffset, SEEK_SET);
+
+    ph.readPos = (long)ph.last.inputOffset;
+    ph.bytesRead = ph.last.inputOffset;
+    ph.bytesWritten = ph.last.outputOffset;
+    ph.carry = (size_t)ph.last.carry;
+    ph.codeTotal = 2 * (ph.last.outputOffset - HEADER_SIZE) / 3 + ph.carry;
+
+    if (VERBOSE_OUTPUT & flags)
+      printf ("Resuming at input offset %lu.\n", ph.last.inputOffset);
+  }
+  else
+    WriteHeader (ph.fout, version, inputSize);
+
+  if (compress_ok && (flags & DEDUP_OUTPUT))
+    compress_ok = PackDedup (&ph, flags);
+  else if (compress_ok && (flags & BLOCKED_OUTPUT))
+    compress_ok = PackFrames (&ph, flags);
+  else if (compress_ok)
+    compress_ok = PackStream (&ph, flags, options->bufferSize ? options->bufferSize : IO_BUFFLEN);
+
+  outputSize = ftell (ph.fout);
+
+  if (compress_ok)
+    FinishProgress (&ph.progress);
+
+  fclose(ph.fp);
+
+  if (EOF == fclose (ph.fout) && compress_ok)
+  {
+    fprintf (stderr, "Write error. Out of disk space?\n");
+    compress_ok = false;
+  }
+
+  /* a resumable job keeps its output for the next run if a checkpoint
+     was loaded or saved; ph.last.outputOffset is 0 otherwise */
+  if (!compress_ok && !ph.last.outputOffset)
+  {
+    cleanup (outfile, flags);
+  }
+
+  if (compress_ok && ph.checkpointFile)
+  {
+    remove (ph.checkpointFile);
+  }
+
+  free (ph.checkpointFile);
+
+  if (options->resetStats)
+    *options->resetStats = ph.monitor.stats;
+
+  if (compress_ok && (VERBOSE_OUTPUT & flags))
+  {
+    printf ("Compression ratio %.2f%%\n", 100.0 * (inputSize - outputSize) / inputSize );
+
+    if (ph.monitoring)
+      printf ("Dictionary resets: %lu (%lu early), %lu bytes packed with a full dictionary.\n",
+              ph.monitor.stats.resets, ph.monitor.stats.earlyResets, ph.monitor.stats.frozenBytes);
+  }
+
+  return compress_ok ? 1 : 0;
+}
+/*-------------------------------------------------*/
+int Append(const char *filename, const char *outfile, int flags)
+{
+  struct lzwOptions options;
+
+  memset (&options, 0, sizeof(options));
+  options.flags = flags;
+
+  return AppendEx (filename, outfile, &options);
+}
+/*-------------------------------------------------*/
+/* New frames go after the last one, then the header gets the new total.
+   The file is cut back to its old end if anything fails, so it is never
+   left with frames the header does not count. */
+int AppendEx(const char *filename, const char *outfile, const struct lzwOptions *options)
+{
+  struct lzwOptions framed = *options;
+  struct lzwHeader hdr;
+  struct packHelper ph;
+  long inputSize, oldEnd;
+  int compress_ok;
+
+  if (!file_exists (outfile))
+  {
+    framed.flags |= BLOCKED_OUTPUT;
+    return CompressEx (filename, outfile, &framed);
+  }
+
+  if (is_big_endian())
+  {
+    fprintf (stderr, "Not supported on big endian machines.\n");
+    return 0;
+  }
+
+  initializeHelper (&ph, options->flags);
+
+  ph.fp = fopen(filename, "rb");
+
+  if (NULL == ph.fp)
+  {
+    fprintf (stderr, "Cannot open input file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  ph.fout = fopen (outfile, "r+b");
+
+  if (NULL == ph.fout)
+  {
+    fprintf (stderr, "Cannot open output file \'%s\'.\n", outfile);
+    perror (NULL);
+    fclose (ph.fp);
+    return 0;
+  }
+
+  fseek (ph.fp, 0, SEEK_END);
+  ph.inputSize = inputSize = ftell (ph.fp);
+  fseek (ph.fp, 0, SEEK_SET);
+
+  compress_ok = ReadHeader (ph.fout, &hdr);
+
+  if (compress_ok && hdr.version != FRAMED_VERSION)
+  {
+    fprintf (stderr, "Only framed (-b) files can be appended to.\n");
+    compress_ok = false;
+  }
+
+  if (compress_ok && (inputSize < 0 || (unsigned long)inputSize > 0xFFFFFFFFUL - hdr.inputSize))
+  {
+    fprintf (stderr, "Total size over 4 GB.\n");
+    compress_ok = false;
+  }
+
+  if (!compress_ok)
+  {
+    fclose (ph.fp);
+    fclose (ph.fout);
+    return 0;
+  }
+
+  fseek (ph.fout, 0, SEEK_END);
+  oldEnd = ftell (ph.fout);
+
+  InitProgress (&ph.progress, options, inputSize, false);
+
+  compress_ok = PackFrames (&ph, options->flags) && (0 == fflush (ph.fout));
+
+  if (compress_ok)
+  {
+    fseek (ph.fout, 0, SEEK_SET);
+    compress_ok = WriteHeader (ph.fout, FRAMED_VERSION, hdr.inputSize + (uint32_t)inputSize);
+  }
+
+  if (compress_ok)
+    FinishProgress (&ph.progress);
+  else if (!truncate_file (ph.fout, oldEnd))
+    fprintf (stderr, "Cannot restore \'%s\'.\n", outfile);
+
+  fclose (ph.fp);
+
+  if (EOF == fclose (ph.fout))
+  {
+    fprintf (stderr, "Write error. Out of disk space?\n");
+    compress_ok = false;
+  }
+
+  if (compress_ok && (VERBOSE_OUTPUT & options->flags))
+  {
+    printf ("Appended %ld bytes, %ld total.\n", inputSize, (long)hdr.inputSize + inputSize);
+  }
+
+  return compress_ok ? 1 : 0;
+}
@@ -1,277 +1,585 @@
-/* This code is based on Mark Nelson's 1995 book. */
-
-/* MY ORIGINAL 1996 COMMENT: */
-
-/*************************************************/
-/*   Программа распаковщика для алгоритма LZW    */
-/*   полная очистка словаря при заполнении       */
-/*   длина выходных кодов постоянна (12 бит)     */
-/*************************************************/
-
-/* TRANSLATION: */
-
-/**************************************************/
-/*  LZW decompression program with full           */        
-/*  dictionary reset when filled up. Constant     */
-/*  12-bit codes in input.                        */
-/**************************************************/
-
-#include "common.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <errno.h>
-#include <assert.h>
-#include <stdint.h>
-
-#define CLEAR_BYTE      0x10  /* it can be any value between 0x10 and 0xFF */
-#define NOT_CODE        (CLEAR_BYTE | (CLEAR_BYTE << 8))
-
-static int16_t GetPrefixChar(int16_t code, const uint16_t * prefix)
-{
-  while (code >= 256)
-  {
-    assert (code < HT_MAX_CODE && code >= 0);
-    code = prefix[code];
-  }
-
-  return code;
-}
-
-int Decompress(const char *filename, const char *outfile, int flags)
-{
-  int i = 0, k, len, bpos = 0;
-  int16_t RunCode = 256, OldCode = NOT_CODE, CurPrefix;
-  uint16_t code;
-  uint8_t *buffer = NULL;
-  uint8_t infoBits = 0;
-  uint8_t infoFlag = 0;
-  uint32_t expectedSize = 0;
-  FILE *fp = NULL;
-  FILE *fout = NULL; 
-  uint16_t StackCount = 0;
-  char label[4] = { 0 };
-  uint8_t version = 255;
-  uint16_t stack [BUFFLEN];
-  uint16_t suffix [HT_MAX_CODE];
-  uint8_t outline [BUFFLEN];
-  uint16_t prefix [HT_MAX_CODE];
-
-  if (is_big_endian())
-  {
-    fprintf (stderr, "Not supported on big endian machines.\n");
-    return 0;
-  }
-
-  if (!(flags & OVERWRITE_FLAG) &&  file_exists(outfile))
-  {
-    /* file exists and no overwrite flag set */
-    fprintf (stderr, "File \'%s\' already exists. Use overwrite flag.\n", outfile);
-    return 0;
-  }
-
-  fp = fopen(filename, "rb");
-
-  if (NULL == fp)
-  {
-    fprintf (stderr, "Cannot open file \'%s\'.\n", filename);
-    perror (NULL);
-    return 0;
-  }
-  
-  if (4 != fread(label, 1, 4, fp))
-  {
-    printf("Not an LZW file!\n");
-    fclose (fp);
-    return 0;
-  }
-
-  if (memcmp(label, "LZW", 3) != 0)
-  {
-    printf("Not an LZW file!\n");
-    fclose (fp);
-    return 0;
-  }
-
-  if (1 != fread (&version, 1, 1, fp))
-  {
-    fprintf(stderr, "Unexpected read error.\n");
-    fclose (fp);
-    return 0;
-  }
-
-  if (version != PACKER_VERSION)
-  {
-    fprintf(stderr, "Packer/unpacker version mismatch.\n");
-    fclose (fp);
-    return 0;
-  }
-
-  infoBits |= (is_big_endian() ? 1 : 0);
-  infoBits |= VARIABLE_WIDTH ? 2 : 0;
-  infoBits |= ((MAX_BITS - 8) << 4);
-
-  /* get infoFlags byte: */
-
-  if (1 != fread (&infoFlag, 1, 1, fp))
-  {
-    fprintf(stderr, "Unexpected read error.\n");
-    fclose (fp);
-    return 0;
-  }
-
-  if (infoBits != infoFlag)
-  {
-    fprintf(stderr, "Encoding flags mismatch.\n");
-    fclose (fp);
-    return 0;
-  }
-
-  /* get expected output size: */
-
-  expectedSize = 0;
-  if (4 != fread (&expectedSize, 1, sizeof(uint32_t), fp))
-  {
-    fprintf(stderr, "Unexpected read error.\n");
-    fclose (fp);
-    return 0;
-  }
-
-  if (flags & VERBOSE_OUTPUT)
-  {
-    printf ("expected output size: %ld.\n", (long)expectedSize);
-  }
-
-  fout = fopen(outfile, "wb");
-
-  if (NULL == fout)
-  {
-    fprintf (stderr, "Cannot open file \'%s\'.\n", outfile);
-    perror (NULL);
-    fclose (fp);
-    return 0;
-  }
-
-  buffer = (unsigned char *)malloc(OUTLEN);
-
-  if (!buffer)
-  {
-    perror (NULL);
-    fclose(fout);
-    fclose(fp);
-    cleanup (outfile, flags);
-    return 0;
-  }
-
-  memset(prefix, CLEAR_BYTE, HT_SIZE);
-
-  memset (suffix, 0, sizeof(suffix)); /* this is just to make static analyzer happy */
-  
-  while (true)
-  {
-    len = (int)fread(buffer, 1, OUTLEN, fp);
-    for (k = 0; k < len;)
-    {
-      if (bpos == 0)
-      {
-        code = *(uint16_t *)(buffer + k) & 0x0FFF; /* assuming little endian */
-        bpos = 4;
-        k++;
-      }
-      else
-      {
-        code = *(uint16_t *)(buffer + k) >> 4;    /* assuming little endian */
-        bpos = 0;
-        k += 2;
-      }
-
-      if (code == EOF_CODE)
-      {
-        if (i != (int)fwrite (outline, 1, i, fout))
-        {
-          /* write error */
-          free (buffer);
-          fclose (fout);
-          fclose (fp);
-          cleanup (outfile, flags);
-          fprintf (stderr, "Write error. Out of disk space?\n");
-          return 0;
-        }
-
-        free (buffer);
-        fflush (fout);
-        fclose (fp);
-
-        /* compare expected size with actual size. */
-
-        if (expectedSize != ftell (fout))
-        {
-          fprintf (stderr, "Expected and actual sizes dont match.\n");
-          fclose (fout);
-          cleanup (outfile, flags);
-          return 0;
-        }
-
-        fclose(fout);
-
-        return 1;
-      }
-
-      else if (code == HT_CLEAR_CODE)
-      {
-        memset(prefix, CLEAR_BYTE, HT_SIZE);
-        RunCode = 256;
-        OldCode = NOT_CODE;
-      }
-      else
-      {
-        if (code < 256)
-          outline[i++] = (uint8_t)code;
-        else
-        {
-          if (prefix[code] == NOT_CODE)
-          {
-            CurPrefix = OldCode;
-            suffix[RunCode] = GetPrefixChar(OldCode, prefix);
-            stack[StackCount++] = suffix[RunCode];
-          }
-          else
-            CurPrefix = code;
-          while (CurPrefix > 255)
-          {
-            stack[StackCount++] = suffix[CurPrefix];
-            CurPrefix = prefix[CurPrefix];
-          }
-          stack[StackCount++] = CurPrefix;
-          while (StackCount != 0)
-            outline[i++] = (uint8_t)stack[--StackCount];
-        }
-        if ((OldCode != NOT_CODE))
-        {
-          prefix[RunCode] = OldCode;
-          if (code != RunCode)
-            suffix[RunCode] = GetPrefixChar(code, prefix);
-          RunCode++;
-        }
-        OldCode = code;
-        if (i == BUFFLEN)
-        {
-          if (BUFFLEN != fwrite(outline, 1, BUFFLEN, fout))
-          {
-            /* write error */
-            free (buffer);
-            fclose (fout);
-            fclose (fp);
-            cleanup (outfile, flags);
-            fprintf (stderr, "Write error. Out of disk space?\n");
-            return 0;
-          }
-
-          i = 0;
-          OldCode = NOT_CODE;
-        }
-      }
-    }
-  }
-} 
+/* This code is based on Mark Nelson's 1995 book. */
+
+/* MY ORIGINAL 1996 COMMENT: */
+
+/*************************************************/
+/*   Программа распаковщика для алгоритма LZW    */
+/*   полная очистка словаря при заполнении       */
+/*   длина выходных кодов постоянна (12 бит)     */
+/*************************************************/
+
+/* TRANSLATION: */
+
+/**************************************************/
+/*  LZW decompression program with full           */        
+/*  dictionary reset when filled up. Constant     */
+/*  12-bit codes in input.                        */
+/**************************************************/
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdint.h>
+
+#define CLEAR_BYTE      0x10  /* it can be any value between 0x10 and 0xFF */
+#define NOT_CODE        (CLEAR_BYTE | (CLEAR_BYTE << 8))
+
+static int16_t GetPrefixChar(int16_t code, const uint16_t * prefix)
+{
+  while (code >= 256)
+  {
+    assert (code < HT_MAX_CODE && code >= 0);
+    code = prefix[code];
+  }
+
+  return code;
+}
+/*--------------------------------------------------------------------*/
+void ResetUnpackHelper (struct unpackHelper *uh)
+{
+  memset(uh->prefix, CLEAR_BYTE, HT_SIZE);
+  memset (uh->suffix, 0, sizeof(uh->suffix)); /* this is just to make static analyzer happy */
+  uh->RunCode = 256;
+  uh->OldCode = NOT_CODE;
+}
+/*--------------------------------------------------------------------*/
+int ExpandCode (struct unpackHelper *uh, uint16_t code, uint8_t *out, size_t avail)
+{
+  uint16_t *prefix = uh->prefix, *suffix = uh->suffix, *stack = uh->stack;
+  int16_t RunCode = uh->RunCode, OldCode = uh->OldCode, CurPrefix;
+  int StackCount = 0, i = 0;
+
+  if (code < 256)
+  {
+    if (avail < 1)
+      return -1;
+
+    out[i++] = (uint8_t)code;
+  }
+  else
+  {
+    if (prefix[code] == NOT_CODE)
+    {
+      /* only the code about to be defined can be unknown */
+      if (code != RunCode || OldCode == NOT_CODE)
+        return -1;
+
+      CurPrefix = OldCode;
+      suffix[RunCode] = GetPrefixChar(OldCode, prefix);
+      stack[StackCount++] = suffix[RunCode];
+    }
+    else
+      CurPrefix = code;
+    while (CurPrefix > 255)
+    {
+      stack[StackCount++] = suffix[CurPrefix];
+      CurPrefix = prefix[CurPrefix];
+    }
+    stack[StackCount++] = CurPrefix;
+
+    if ((size_t)StackCount > avail)
+      return -1;
+
+    while (StackCount != 0)
+      out[i++] = (uint8_t)stack[--StackCount];
+  }
+  if ((OldCode != NOT_CODE) && RunCode < HT_CLEAR_CODE)
+  {
+    prefix[RunCode] = OldCode;
+    if (code != RunCode)
+      suffix[RunCode] = GetPrefixChar(code, prefix);
+    RunCode++;
+  }
+
+  uh->RunCode = RunCode;
+  uh->OldCode = code;
+
+  return i;
+}
+/*--------------------------------------------------------------------*/
+int DecodeCodes (const struct lzwKernels *k, struct unpackHelper *uh,
+                 const uint8_t *packed, size_t len, uint16_t *codes,
+                 uint8_t *out, size_t rawSize, size_t phraseBlock)
+{
+  size_t count = k->unpack_codes (packed, len, codes), c, i = 0;
+  int n;
+
+  ResetUnpackHelper (uh);
+
+  for (c = 0; c < count; c++)
+  {
+    if (codes[c] == EOF_CODE)
+      return (i == rawSize) ? 1 : 0;
+
+    if (codes[c] == HT_CLEAR_CODE)
+    {
+      ResetUnpackHelper (uh);
+      continue;
+    }
+
+    if ((n = ExpandCode (uh, codes[c], out + i, rawSize - i)) < 0)
+      return 0;
+
+    i += n;
+
+    if (phraseBlock != 0 && i % phraseBlock == 0)
+      uh->OldCode = NOT_CODE;
+  }
+
+  return 0; /* no EOF_CODE */
+}
+/*--------------------------------------------------------------------*/
+/* fwrite of len bytes that start at offset in the output. With sparse,
+   whole SPARSE_BLOCK blocks of zeros are skipped over with fseek; the
+   caller sets the final size. */
+static int WriteOutput (FILE *fout, const uint8_t *data, size_t len, unsigned long offset, int sparse)
+{
+  size_t run = 0, n;
+
+  if (!sparse)
+    return len == fwrite (data, 1, len, fout);
+
+  while (run < len)
+  {
+    n = SPARSE_BLOCK - (offset + run) % SPARSE_BLOCK;
+
+    if (n > len - run)
+      n = len - run;
+
+    if (n == SPARSE_BLOCK && IsZero (data + run, n))
+    {
+      if (run != fwrite (data, 1, run, fout) || 0 != fseek (fout, n, SEEK_CUR))
+        return 0;
+
+      data += run + n;
+      offset += run + n;
+      len -= run + n;
+      run = 0;
+    }
+    else
+      run += n;
+  }
+
+  return len == fwrite (data, 1, len, fout);
+}
+/*--------------------------------------------------------------------*/
+int ExpandSegment (struct unpackHelper *uh, const uint16_t *codes, size_t count,
+                   uint8_t *out, size_t rawSize, unsigned long offset, size_t phraseBlock)
+{
+  size_t c, i = 0;
+  int n;
+
+  ResetUnpackHelper (uh);
+
+  for (c = 0; c < count; c++)
+  {
+    if ((n = ExpandCode (uh, codes[c], out + i, rawSize - i)) < 0)
+      return 0;
+
+    i += n;
+
+    if (phraseBlock != 0 && (offset + i) % phraseBlock == 0)
+      uh->OldCode = NOT_CODE;
+  }
+
+  return (i == rawSize) ? 1 : 0;
+}
+/*--------------------------------------------------------------------*/
+/* Version 0 and CONTINUOUS_VERSION streams. In version 0 the packer
+   starts a new phrase every BUFFLEN input bytes, so the dictionary is not
+   extended across that boundary and no string crosses it. bufferSize
+   only sets the read and write sizes. */
+static int UnpackStream (FILE *fp, FILE *fout, uint32_t *produced, struct progressState *ps,
+                         int version, size_t bufferSize, int sparse)
+{
+  int n, blocks = (version == PACKER_VERSION);
+  size_t i = 0, k, len, count, avail, left;
+  size_t readLen = (bufferSize < OUTLEN) ? OUTLEN : bufferSize - bufferSize % 3;
+  size_t outCap = (bufferSize < BUFFLEN) ? BUFFLEN : bufferSize;
+  unsigned long consumed = HEADER_SIZE;
+  uint16_t code;
+  uint8_t *buffer = NULL, *outline = NULL;
+  uint16_t *codes = NULL;
+  struct unpackHelper *uh = NULL;
+  const struct lzwKernels *kernels = GetKernels ();
+
+  buffer = (uint8_t *)malloc(readLen);
+  outline = (uint8_t *)malloc(outCap);
+  codes = (uint16_t *)malloc(UNPACKED_COUNT(readLen) * sizeof(uint16_t));
+  uh = (struct unpackHelper *)malloc(sizeof(struct unpackHelper));
+
+  if (!buffer || !outline || !codes || !uh)
+  {
+    perror (NULL);
+    free (buffer); free (outline); free (codes); free (uh);
+    return 0;
+  }
+
+  ResetUnpackHelper (uh);
+
+  *produced = 0;
+
+  while (true)
+  {
+    len = fread(buffer, 1, readLen, fp);
+
+    if (len == 0)
+    {
+      /* ran out of input before EOF_CODE */
+      fprintf (stderr, "Unexpected end of file.\n");
+      break;
+    }
+
+    consumed += len;
+    count = kernels->unpack_codes (buffer, len, codes);
+
+    for (k = 0; k < count; k++)
+    {
+      code = codes[k];
+
+      if (code == EOF_CODE)
+      {
+        if (!WriteOutput (fout, outline, i, *produced, sparse))
+        {
+          fprintf (stderr, "Write error. Out of disk space?\n");
+          break;
+        }
+
+        *produced += i;
+
+        free (buffer); free (outline); free (codes); free (uh);
+        return 1;
+      }
+
+      else if (code == HT_CLEAR_CODE)
+      {
+        ResetUnpackHelper (uh);
+      }
+      else
+      {
+        avail = outCap - i;
+
+        /* a version 0 string ending past its block is corrupt */
+        if (blocks && (left = BUFFLEN - (*produced + i) % BUFFLEN) < avail)
+          avail = left;
+
+        if ((n = ExpandCode (uh, code, outline + i, avail)) < 0)
+        {
+          fprintf (stderr, "Corrupt input.\n");
+          break;
+        }
+        i += n;
+
+        if (blocks && (*produced + i) % BUFFLEN == 0)
+          uh->OldCode = NOT_CODE;
+
+        /* no string is longer than HT_MAX_CODE */
+        if (outCap - i < HT_MAX_CODE)
+        {
+          if (!WriteOutput (fout, outline, i, *produced, sparse))
+          {
+            fprintf (stderr, "Write error. Out of disk space?\n");
+            break;
+          }
+
+          *produced += i;
+          i = 0;
+        }
+      }
+    }
+
+    if (k < count || !UpdateProgress (ps, consumed, *produced + i))
+      break;
+  }
+
+  free (buffer); free (outline); free (codes); free (uh);
+  return 0;
+}
+/*--------------------------------------------------------------------*/
+/* Reads back len bytes written at offset into data, then goes back to
+   end. The part of a trailing hole not yet in the file reads as zeros. */
+static int ReadOutput (FILE *fout, uint8_t *data, size_t len, unsigned long offset, unsigned long end)
+{
+  size_t n;
+
+  if (0 != fseek (fout, (long)offset, SEEK_SET))
+    return 0;
+
+  n = fread (data, 1, len, fout);
+  memset (data + n, 0, len - n);
+
+  return 0 == fseek (fout, (long)end, SEEK_SET);
+}
+/*--------------------------------------------------------------------*/
+/* FRAMED_VERSION: a sequence of rawSize, packedSize, packed codes records
+   until end of file. DEDUP_VERSION adds reference frames, copied from
+   the output written so far; fout must be open for reading too. */
+static int UnpackFrames (FILE *fp, FILE *fout, uint32_t *produced, struct progressState *ps,
+                         int sparse, int dedup)
+{
+  uint8_t header[FRAME_HEADER_SIZE], ref[REFERENCE_SIZE];
+  uint32_t source;
+  uint8_t *packed = NULL, *outline = NULL;
+  uint16_t *codes = NULL;
+  size_t packedCap = 0, rawCap = 0, len;
+  uint32_t rawSize, packedSize;
+  struct unpackHelper *uh;
+  const struct lzwKernels *kernels = GetKernels ();
+  unsigned long consumed = HEADER_SIZE;
+  int unpack_ok = true;
+
+  uh = (struct unpackHelper *)malloc(sizeof(struct unpackHelper));
+
+  if (!uh)
+  {
+    perror (NULL);
+    return 0;
+  }
+
+  *produced = 0;
+
+  while (unpack_ok)
+  {
+    len = fread (header, 1, FRAME_HEADER_SIZE, fp);
+
+    if (len == 0)
+      break;
+
+    if (len != FRAME_HEADER_SIZE)
+    {
+      fprintf (stderr, "Unexpected end of file.\n");
+      unpack_ok = false;
+      break;
+    }
+
+    rawSize = get_u32 (header);
+    packedSize = get_u32 (header + 4);
+
+    if (dedup && packedSize == REFERENCE_FRAME)
+    {
+      if (REFERENCE_SIZE != fread (ref, 1, REFERENCE_SIZE, fp))
+      {
+        fprintf (stderr, "Unexpected end of file.\n");
+        unpack_ok = false;
+        break;
+      }
+
+      source = get_u32 (ref);
+
+      if (rawSize > CHUNK_MAX || source > *produced || rawSize > *produced - source)
+      {
+        fprintf (stderr, "Corrupt input.\n");
+        unpack_ok = false;
+        break;
+      }
+
+      if (rawSize > rawCap)
+      {
+        free (outline);
+        rawCap = rawSize;
+        outline = (uint8_t *)malloc(rawCap);
+      }
+
+      if (rawSize && !outline)
+      {
+        perror (NULL);
+        unpack_ok = false;
+        break;
+      }
+
+      if (!ReadOutput (fout, outline, rawSize, source, *produced) ||
+          !WriteOutput (fout, outline, rawSize, *produced, sparse))
+      {
+        fprintf (stderr, "Cannot copy earlier output.\n");
+        unpack_ok = false;
+        break;
+      }
+
+      *produced += rawSize;
+      consumed += FRAME_HEADER_SIZE + REFERENCE_SIZE;
+
+      if (!UpdateProgress (ps, consumed, *produced))
+        unpack_ok = false;
+
+      continue;
+    }
+
+    if (packedSize > FRAME_BOUND(rawSize))
+    {
+      fprintf (stderr, "Corrupt input.\n");
+      unpack_ok = false;
+      break;
+    }
+
+    if (packedSize > packedCap)
+    {
+      free (packed);
+      free (codes);
+      packedCap = packedSize;
+      packed = (uint8_t *)malloc(packedCap);
+      codes = (uint16_t *)malloc(UNPACKED_COUNT(packedCap) * sizeof(uint16_t));
+    }
+
+    if (rawSize > rawCap)
+    {
+      free (outline);
+      rawCap = rawSize;
+      outline = (uint8_t *)malloc(rawCap);
+    }
+
+    if ((packedSize && (!packed || !codes)) || (rawSize && !outline))
+    {
+      perror (NULL);
+      unpack_ok = false;
+      break;
+    }
+
+    if (packedSize != fread (packed, 1, packedSize, fp))
+    {
+      fprintf (stderr, "Unexpected end of file.\n");
+      unpack_ok = false;
+      break;
+    }
+
+    if (!DecodeCodes (kernels, uh, packed, packedSize, codes, outline, rawSize, 0))
+    {
+      fprintf (stderr, "Corrupt input.\n");
+      unpack_ok = false;
+      break;
+    }
+
+    if (!WriteOutput (fout, outline, rawSize, *produced, sparse))
+    {
+      fprintf (stderr, "Write error. Out of disk space?\n");
+      unpack_ok = false;
+      break;
+    }
+
+    *produced += rawSize;
+    consumed += FRAME_HEADER_SIZE + packedSize;
+
+    if (!UpdateProgress (ps, consumed, *produced))
+      unpack_ok = false;
+  }
+
+  free (packed);
+  free (codes);
+  free (outline);
+  free (uh);
+
+  return unpack_ok;
+}
+/*--------------------------------------------------------------------*/
+int Decompress(const char *filename, const char *outfile, int flags)
+{
+  struct lzwOptions options;
+
+  memset (&options, 0, sizeof(options));
+  options.flags = flags;
+
+  return DecompressEx (filename, outfile, &options);
+}
+/*--------------------------------------------------------------------*/
+int DecompressEx(const char *filename, const char *outfile, const struct lzwOptions *options)
+{
+  FILE *fp = NULL;
+  FILE *fout = NULL; 
+  struct lzwHeader hdr;
+  struct progressState ps;
+  uint32_t produced = 0;
+  int unpack_ok, flags = options->flags;
+
+  if (is_big_endian())
+  {
+    fprintf (stderr, "Not supported on big endian machines.\n");
+    return 0;
+  }
+
+  if (!(flags & OVERWRITE_FLAG) &&  file_exists(outfile))
+  {
+    /* file exists and no overwrite flag set */
+    fprintf (stderr, "File \'%s\' already exists. Use overwrite flag.\n", outfile);
+    return 0;
+  }
+
+  fp = fopen(filename, "rb");
+
+  if (NULL == fp)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  if (!ReadHeader (fp, &hdr))
+  {
+    fclose (fp);
+    return 0;
+  }
+
+  if (flags & VERBOSE_OUTPUT)
+  {
+    printf ("expected output size: %ld.\n", (long)hdr.inputSize);
+  }
+
+  /* reference frames are copied from what was written before */
+  fout = fopen(outfile, (hdr.version == DEDUP_VERSION) ? "w+b" : "wb");
+
+  if (NULL == fout)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", outfile);
+    perror (NULL);
+    fclose (fp);
+    return 0;
+  }
+
+  InitProgress (&ps, options, hdr.inputSize, true);
+
+  if (hdr.version == FRAMED_VERSION || hdr.version == DEDUP_VERSION)
+    unpack_ok = UnpackFrames (fp, fout, &produced, &ps, flags & SPARSE_OUTPUT,
+                              hdr.version == DEDUP_VERSION);
+  else
+    unpack_ok = UnpackStream (fp, fout, &produced, &ps, hdr.version,
+                              options->bufferSize ? options->bufferSize : IO_BUFFLEN, flags & SPARSE_OUTPUT);
+
+  /* a trailing hole was only seeked over */
+  if (unpack_ok && (flags & SPARSE_OUTPUT) && !truncate_file (fout, produced))
+  {
+    fprintf (stderr, "Write error. Out of disk space?\n");
+    unpack_ok = false;
+  }
+
+  if (unpack_ok)
+  {
+    ps.bytesIn = ftell (fp);
+    ps.bytesOut = produced;
+    FinishProgress (&ps);
+  }
+
+  fclose (fp);
+
+  /* compare expected size with actual size. */
+
+  if (unpack_ok && hdr.inputSize != produced)
+  {
+    fprintf (stderr, "Expected and actual sizes dont match.\n");
+    unpack_ok = false;
+  }
+
+  if (EOF == fclose (fout))
+  {
+    fprintf (stderr, "Write error. Out of disk space?\n");
+    unpack_ok = false;
+  }
+
+  if (!unpack_ok)
+  {
+    cleanup (outfile, flags);
+  }
+
+  return unpack_ok ? 1 : 0;
+}
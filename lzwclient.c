@@ -0,0 +1,176 @@
+/* Client library for lzw06 --serve. See lzwclient.h for the protocol. */
+
+#define _GNU_SOURCE
+
+#include "lzwclient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+static int SendAll (int fd, const uint8_t *p, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0)
+  {
+    n = send (fd, p, len, MSG_NOSIGNAL);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return 0;
+
+    p += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int RecvAll (int fd, uint8_t *p, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0)
+  {
+    n = recv (fd, p, len, 0);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n <= 0)
+      return 0;
+
+    p += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int LzwConnect (const char *path)
+{
+  struct sockaddr_un addr;
+  int fd;
+
+  if (strlen (path) >= sizeof(addr.sun_path))
+  {
+    fprintf (stderr, "Socket path too long.\n");
+    return -1;
+  }
+
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return -1;
+
+  memset (&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  if (connect (fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+  {
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*--------------------------------------------------------------------*/
+
+int LzwRequest (int fd, int op, const void *in, size_t size,
+                void **out, size_t *outSize, int *status)
+{
+  uint8_t header[LZW_MSG_HEADER];
+  uint8_t *payload = NULL;
+  uint32_t len;
+
+  *out = NULL;
+  *outSize = 0;
+
+  if (size > LZW_MAX_PAYLOAD)
+    return 0;
+
+  len = (uint32_t)size;
+  header[0] = (uint8_t)len;
+  header[1] = (uint8_t)(len >> 8);
+  header[2] = (uint8_t)(len >> 16);
+  header[3] = (uint8_t)(len >> 24);
+  header[4] = (uint8_t)op;
+
+  if (!SendAll (fd, header, LZW_MSG_HEADER) || !SendAll (fd, (const uint8_t *)in, size))
+    return 0;
+
+  if (!RecvAll (fd, header, LZW_MSG_HEADER))
+    return 0;
+
+  len = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+
+  if (len > LZW_MAX_RESPONSE)
+    return 0;
+
+  if (len > 0)
+  {
+    payload = (uint8_t *)malloc(len);
+
+    if (payload == NULL || !RecvAll (fd, payload, len))
+    {
+      free (payload);
+      return 0;
+    }
+  }
+
+  *out = payload;
+  *outSize = len;
+  *status = header[4];
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void LzwDisconnect (int fd)
+{
+  if (fd >= 0)
+    close (fd);
+}
+
+#else
+
+int LzwConnect (const char *path)
+{
+  (void)path;
+  fprintf (stderr, "Server mode is supported on Linux only.\n");
+  return -1;
+}
+
+int LzwRequest (int fd, int op, const void *in, size_t size,
+                void **out, size_t *outSize, int *status)
+{
+  (void)fd; (void)op; (void)in; (void)size; (void)status;
+  *out = NULL;
+  *outSize = 0;
+  return 0;
+}
+
+void LzwDisconnect (int fd)
+{
+  (void)fd;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+/* Client side of the lzw06 --serve protocol (Linux only).
+
+   Every message is a 5 byte header followed by a payload:
+     request:  u32 payload length (little endian), u8 operation
+     response: u32 payload length (little endian), u8 status
+   Compress responses hold a framed (-b) image, decompress requests
+   accept either format. A connection may carry any number of requests,
+   one at a time. */
+
+#include <stddef.h>
+
+#define LZW_MSG_HEADER    5
+#define LZW_MAX_PAYLOAD   (16 << 20)   /* larger requests close the connection */
+#define LZW_MAX_RESPONSE  (2 * LZW_MAX_PAYLOAD)   /* above CompressBound(LZW_MAX_PAYLOAD) */
+
+#define LZW_OP_COMPRESS   'C'
+#define LZW_OP_DECOMPRESS 'D'
+
+enum { LZW_STATUS_OK = 0, LZW_STATUS_BAD_REQUEST = 1, LZW_STATUS_CORRUPT = 2,
+       LZW_STATUS_TOO_LARGE = 3, LZW_STATUS_NO_MEMORY = 4 };
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Returns a connected socket, or -1. */
+extern int LzwConnect (const char *path);
+
+/* Sends one request and waits for its response. On success *out is a
+   malloc'ed buffer the caller frees (NULL for an empty payload), *status
+   is the server status. Returns 1 if a response was received, 0 on I/O
+   or protocol error, after which the connection should be closed. */
+extern int LzwRequest (int fd, int op, const void *in, size_t size,
+                       void **out, size_t *outSize, int *status);
+
+extern void LzwDisconnect (int fd);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
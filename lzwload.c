@@ -0,0 +1,232 @@
+/* Load generator for lzw06 --serve.
+
+   usage: lzw_load socket file [connections] [requests]
+
+   Each connection is a thread that sends the file as a compress request
+   `requests` times, decompresses the first answer back to check it, and
+   records the latency of every request. Prints throughput and latency
+   percentiles over all connections. */
+
+#define _GNU_SOURCE
+
+#include "lzwclient.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+struct loadThread
+{
+  pthread_t thread;
+  const char *path;
+  const uint8_t *data;
+  size_t size;
+  int requests;
+  double *latency;   /* seconds, one per request */
+  int completed;
+  int failed;
+};
+
+/*--------------------------------------------------------------------*/
+
+static double Now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Verify (int fd, const struct loadThread *t, const void *packed, size_t size)
+{
+  void *out;
+  size_t outSize;
+  int status, ok;
+
+  if (!LzwRequest (fd, LZW_OP_DECOMPRESS, packed, size, &out, &outSize, &status))
+    return 0;
+
+  ok = status == LZW_STATUS_OK && outSize == t->size
+       && (outSize == 0 || memcmp (out, t->data, outSize) == 0);
+
+  free (out);
+
+  return ok;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void *RunConnection (void *arg)
+{
+  struct loadThread *t = (struct loadThread *)arg;
+  void *out;
+  size_t outSize;
+  double start;
+  int fd, status, i;
+
+  fd = LzwConnect (t->path);
+
+  if (fd < 0)
+  {
+    perror ("connect");
+    t->failed = t->requests;
+    return NULL;
+  }
+
+  for (i = 0; i < t->requests; i++)
+  {
+    start = Now ();
+
+    if (!LzwRequest (fd, LZW_OP_COMPRESS, t->data, t->size, &out, &outSize, &status))
+    {
+      t->failed += t->requests - i;
+      break;
+    }
+
+    t->latency[t->completed++] = Now () - start;
+
+    if (status != LZW_STATUS_OK || (i == 0 && !Verify (fd, t, out, outSize)))
+      t->failed++;
+
+    free (out);
+  }
+
+  LzwDisconnect (fd);
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int CompareDouble (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+static double Percentile (const double *sorted, size_t n, double p)
+{
+  size_t k = (size_t)(p * (n - 1) + 0.5);
+
+  return sorted[k];
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint8_t *ReadInput (const char *file, size_t *size)
+{
+  FILE *fp = fopen (file, "rb");
+  uint8_t *data;
+  long len;
+
+  if (fp == NULL)
+    return NULL;
+
+  fseek (fp, 0, SEEK_END);
+  len = ftell (fp);
+  fseek (fp, 0, SEEK_SET);
+
+  data = (uint8_t *)malloc(len > 0 ? len : 1);
+
+  if (data && (size_t)len != fread (data, 1, len, fp))
+  {
+    free (data);
+    data = NULL;
+  }
+
+  fclose (fp);
+  *size = len;
+
+  return data;
+}
+
+/*--------------------------------------------------------------------*/
+
+int main (int argc, char *argv[])
+{
+  struct loadThread *threads;
+  double *all, elapsed;
+  size_t size, n = 0;
+  uint8_t *data;
+  int connections = 8, requests = 100, failed = 0, i, k;
+
+  if (argc < 3)
+  {
+    printf ("syntax: lzw_load socket file [connections] [requests] \n");
+    return EXIT_FAILURE;
+  }
+
+  if (argc > 3) connections = atoi (argv[3]);
+  if (argc > 4) requests = atoi (argv[4]);
+
+  if (connections < 1 || requests < 1)
+    return EXIT_FAILURE;
+
+  data = ReadInput (argv[2], &size);
+
+  if (data == NULL || size > LZW_MAX_PAYLOAD)
+  {
+    fprintf (stderr, "Cannot read \'%s\' or larger than %d bytes.\n", argv[2], LZW_MAX_PAYLOAD);
+    free (data);
+    return EXIT_FAILURE;
+  }
+
+  threads = (struct loadThread *)calloc(connections, sizeof(struct loadThread));
+  all = (double *)malloc((size_t)connections * requests * sizeof(double));
+
+  if (!threads || !all)
+  {
+    perror (NULL);
+    return EXIT_FAILURE;
+  }
+
+  elapsed = Now ();
+
+  for (i = 0; i < connections; i++)
+  {
+    threads[i].path = argv[1];
+    threads[i].data = data;
+    threads[i].size = size;
+    threads[i].requests = requests;
+    threads[i].latency = all + (size_t)i * requests;
+    pthread_create (&threads[i].thread, NULL, RunConnection, &threads[i]);
+  }
+
+  for (i = 0; i < connections; i++)
+  {
+    pthread_join (threads[i].thread, NULL);
+    failed += threads[i].failed;
+
+    /* pack latencies to the front of all[] */
+    for (k = 0; k < threads[i].completed; k++)
+      all[n++] = threads[i].latency[k];
+  }
+
+  elapsed = Now () - elapsed;
+
+  printf ("%d connections, %lu requests of %lu bytes, %d failed, %.2f s\n",
+          connections, (unsigned long)n, (unsigned long)size, failed, elapsed);
+
+  if (n > 0)
+  {
+    qsort (all, n, sizeof(double), CompareDouble);
+
+    printf ("throughput %.0f req/s, %.2f MB/s\n", n / elapsed, n * (double)size / elapsed / 1e6);
+    printf ("latency ms: p50 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+            1e3 * Percentile (all, n, 0.50), 1e3 * Percentile (all, n, 0.99),
+            1e3 * Percentile (all, n, 0.999), 1e3 * all[n - 1]);
+  }
+
+  free (threads);
+  free (all);
+  free (data);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -13,7 +13,7 @@
 /*------------------------------------------------------------*/
 /*                                                            */ 
 /*  Includes test option (Linux and Windows only).            */
-/*  Uses cksum or certUtil to verify results.                 */
+/*  Synthetic test uses cksum or certUtil to verify results.  */
 /*  Replace with custom cksum on other platforms.             */
 /*                                                            */ 
 /*------------------------------------------------------------*/
@@ -21,25 +21,93 @@
 #define _GNU_SOURCE /* for popen */
 
 #include "common.h"
+#include "server.h"
+#include "shmring.h"
+#include "roundtrip.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <signal.h>
+
+#if defined(__linux__)
+#include <unistd.h> /* sysconf */
+#endif
 
 #define ONE_KILOBYTE 1024
+#define PROGRESS_INTERVAL (64UL << 20)  /* -v progress line every 64 MB */
 
 enum ByteSequence { SEQ_CONSTANT = 0, SEQ_INCREASING, SEQ_RANDOM };
 
-enum ArgOption { PARSE_ERROR = -1, SYNTHETIC_TEST = 0, FLAG_PACK = 1, FLAG_UNPACK = 2, FLAG_TEST = 3 };
+enum ArgOption { PARSE_ERROR = -1, SYNTHETIC_TEST = 0, FLAG_PACK = 1, FLAG_UNPACK = 2, FLAG_TEST = 3, SERVE = 4, SHM_PACK = 5,
+                 SEARCH = 6, ESTIMATE = 7, FLAG_APPEND = 8 };
 
 struct progArguments
 {
     char *inputFile;
     char *outputFile;
+    char *outputRing;
+    char *pattern;
     int flags;
+    int workers;
+    int overlap;
+    int parallel;
+    unsigned long bufferSize;
+    unsigned long budget;
+    int resetPolicy;
 };
 
+static volatile sig_atomic_t cancelRequested = 0;
+
+/*--------------------------------------------------------------------*/
+
+static void onInterrupt (int sig)
+{
+  (void)sig;
+  cancelRequested = 1; /* the job stops at the next buffer and cleans up */
+}
+
+/*--------------------------------------------------------------------*/
+
+static void showProgress (const struct lzwProgress *p, void *user)
+{
+  (void)user;
+  printf ("%8.1f MB in, %8.1f MB out", p->bytesIn / 1e6, p->bytesOut / 1e6);
+
+  if (p->total)
+  {
+    printf (" (%.1f MB uncompressed)", p->total / 1e6);
+  }
+
+  printf (", %6.1f MB/s\n", p->mbPerSec);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void printHit (unsigned long offset, void *user)
+{
+  (void)user;
+  printf ("%lu\n", offset);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void initOptions (struct lzwOptions *options, int flags, unsigned long bufferSize)
+{
+  memset (options, 0, sizeof(*options));
+
+  options->flags = flags;
+  options->cancel = &cancelRequested;
+  options->bufferSize = bufferSize;
+
+  if (flags & VERBOSE_OUTPUT)
+  {
+    options->progress = showProgress;
+    options->interval = PROGRESS_INTERVAL;
+  }
+}
+
 /*--------------------------------------------------------------------*/
 
 static void show_command (const char* cmd) 
@@ -74,15 +142,177 @@ static void show_command (const char* cmd)
 
 static void printSyntax ()
 {
-  printf ("syntax: lzw06 -(p|u|t) [-v -f -k -t] inputFile outputFile \n");
+  printf ("syntax: lzw06 -(p|u|t|a) [-v -f -k -b -c -d -x -o -j -s] [--buffer=N[K|M]] [--threads=N] [--resume] [--reset=full|ratio|window] inputFile outputFile \n");
+  printf ("        lzw06 -e [-x] [--budget=N[K|M]] inputFile \n");
   printf ("        lzw06 -large [N] \n");
+  printf ("        lzw06 --serve socketPath [workers] [-v -x] \n");
+  printf ("        lzw06 --shm-in ring (--shm-out ring | outputFile) [-v -k -x] \n");
+  printf ("        lzw06 -g pattern inputFile [-v] \n");
   printf ("\t -p - pack \n");
   printf ("\t -u - unpack \n");
+  printf ("\t -a - append inputFile as new frames to framed outputFile (created if missing) \n");
   printf ("\t -v - verbose \n");
   printf ("\t -f - force overwrite; applicable with -u option only \n");
   printf ("\t -k - keep dirty/incomplete output file on failure \n");
-  printf ("\t -t - test option; requires only inputFile \n");
+  printf ("\t -b - blocked output: independent frames \n");
+  printf ("\t -c - continuous output: phrases run across read buffers (format version 2) \n");
+  printf ("\t -d - deduplicated output: frames cut by content, repeated ones stored as references \n");
+  printf ("\t -x - fast mode: single-probe dictionary, slightly worse ratio \n");
+  printf ("\t -t - in-memory round trip test; requires only inputFile \n");
+  printf ("\t -o - with -t: unpack on a second thread while packing (implies -b) \n");
+  printf ("\t -e - print estimated packed/input size ratio; samples up to --budget bytes (default 1M) \n");
+  printf ("\t -s - with -u: leave holes for zero blocks (sparse output file) \n");
+  printf ("\t -j - with -u: unpack on all CPUs, or on --threads=N threads \n");
+  printf ("\t --resume - with -p: checkpoint every 64M of input; continue from the last checkpoint if there is one \n");
+  printf ("\t --reset - with -p and without -b: when to clear the dictionary. full (default) clears it when full;\n");
+  printf ("\t           ratio and window (-c only) keep a full dictionary until the compression ratio drops \n");
+  printf ("\t --buffer - read/write size for -p and -u; does not change the output. Default 1M.\n");
   printf ("\t -large - synthetic data test; N is size in 256 Kb units. Default N is 32.\n");
+  printf ("\t --serve - compression server on a Unix socket; one worker per CPU by default.\n");
+  printf ("\t --shm-in - compress records from a shared memory ring to another ring or a file.\n");
+  printf ("\t -g - print offsets of pattern in the unpacked data without unpacking; exit code 1 if none.\n");
+}
+
+/*--------------------------------------------------------------------*/
+/* size in bytes with an optional K or M suffix; 0 if invalid */
+static unsigned long parseSize (const char *s)
+{
+    char *end;
+    unsigned long size = strtoul (s, &end, 10);
+
+    if (*end == 'K' || *end == 'k')
+    {
+        size <<= 10;
+        end++;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        size <<= 20;
+        end++;
+    }
+
+    return (*end == '\0') ? size : 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* lzw06 --serve socketPath [workers] [-v -x] */
+static enum ArgOption parseServeArguments (int argc, char *argv[], struct progArguments *params)
+{
+    int i;
+
+    if (argc < 3 || argv[2][0] == '-')
+    {
+        return PARSE_ERROR;
+    }
+
+    params->inputFile = str_dup (argv[2]);
+
+    for (i = 3; i < argc; i++)
+    {
+        if (0 == strcmp (argv[i], "-v"))
+        {
+            params->flags |= VERBOSE_OUTPUT;
+        }
+        else if (0 == strcmp (argv[i], "-x"))
+        {
+            params->flags |= FAST_MODE;
+        }
+        else if (atoi (argv[i]) > 0)
+        {
+            params->workers = atoi (argv[i]);
+        }
+        else
+        {
+            fprintf (stderr, "Unknown argument %s\n", argv[i]);
+            return PARSE_ERROR;
+        }
+    }
+
+    return SERVE;
+}
+
+/*--------------------------------------------------------------------*/
+/* lzw06 --shm-in ring (--shm-out ring | outputFile) [-v -k -x] */
+static enum ArgOption parseRingArguments (int argc, char *argv[], struct progArguments *params)
+{
+    int i;
+
+    if (argc < 4 || argv[2][0] == '-')
+    {
+        return PARSE_ERROR;
+    }
+
+    params->inputFile = str_dup (argv[2]);
+
+    for (i = 3; i < argc; i++)
+    {
+        if (0 == strcmp (argv[i], "--shm-out") && i + 1 < argc && params->outputRing == NULL)
+        {
+            params->outputRing = str_dup (argv[++i]);
+        }
+        else if (0 == strcmp (argv[i], "-v"))
+        {
+            params->flags |= VERBOSE_OUTPUT;
+        }
+        else if (0 == strcmp (argv[i], "-k"))
+        {
+            params->flags |= KEEP_ON_ERROR;
+        }
+        else if (0 == strcmp (argv[i], "-x"))
+        {
+            params->flags |= FAST_MODE;
+        }
+        else if (argv[i][0] != '-' && params->outputFile == NULL)
+        {
+            params->outputFile = str_dup (argv[i]);
+        }
+        else
+        {
+            fprintf (stderr, "Unknown argument %s\n", argv[i]);
+            return PARSE_ERROR;
+        }
+    }
+
+    if ((params->outputRing == NULL) == (params->outputFile == NULL))
+    {
+        fprintf (stderr, "Give either --shm-out or an output file.\n");
+        return PARSE_ERROR;
+    }
+
+    return SHM_PACK;
+}
+
+/*--------------------------------------------------------------------*/
+/* lzw06 -g pattern inputFile [-v] */
+static enum ArgOption parseSearchArguments (int argc, char *argv[], struct progArguments *params)
+{
+    int i;
+
+    if (argc < 4)
+    {
+        return PARSE_ERROR;
+    }
+
+    params->pattern = str_dup (argv[2]);
+
+    for (i = 3; i < argc; i++)
+    {
+        if (0 == strcmp (argv[i], "-v"))
+        {
+            params->flags |= VERBOSE_OUTPUT;
+        }
+        else if (argv[i][0] != '-' && params->inputFile == NULL)
+        {
+            params->inputFile = str_dup (argv[i]);
+        }
+        else
+        {
+            fprintf (stderr, "Unknown argument %s\n", argv[i]);
+            return PARSE_ERROR;
+        }
+    }
+
+    return (params->inputFile != NULL) ? SEARCH : PARSE_ERROR;
 }
 
 /*--------------------------------------------------------------------*/
@@ -97,6 +327,17 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
     int flagVerbose = 0;
     int flagKeepDirty = 0;
     int flagTest = 0;
+    int flagBlocked = 0;
+    int flagFast = 0;
+    int flagOverlap = 0;
+    int flagContinuous = 0;
+    int flagParallel = 0;
+    int flagEstimate = 0;
+    int flagAppend = 0;
+    int flagSparse = 0;
+    int flagDedup = 0;
+    int flagResume = 0;
+    int flagReset = 0;
 
     int ret = 0, i, j;
 
@@ -104,7 +345,15 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
 
     params->inputFile = NULL;
     params->outputFile = NULL;
+    params->outputRing = NULL;
+    params->pattern = NULL;
     params->flags = 0;
+    params->workers = 0;
+    params->overlap = 0;
+    params->parallel = 0;
+    params->bufferSize = 0;
+    params->budget = 0;
+    params->resetPolicy = LZW_RESET_FULL;
 
 
     if (argc == 1)
@@ -126,6 +375,79 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
                 return SYNTHETIC_TEST; /* large test */
             }
 
+            if ((i == 1) && 0 == strcmp(argv[1], "--serve"))
+            {
+                return parseServeArguments (argc, argv, params);
+            }
+
+            if ((i == 1) && 0 == strcmp(argv[1], "--shm-in"))
+            {
+                return parseRingArguments (argc, argv, params);
+            }
+
+            if ((i == 1) && 0 == strcmp(argv[1], "-g"))
+            {
+                return parseSearchArguments (argc, argv, params);
+            }
+
+            if (0 == strncmp(argv[i], "--buffer=", 9))
+            {
+                if (0 == (params->bufferSize = parseSize (argv[i] + 9)))
+                {
+                    fprintf (stderr, "Invalid buffer size %s\n", argv[i] + 9);
+                    return PARSE_ERROR;
+                }
+
+                continue;
+            }
+
+            if (0 == strncmp(argv[i], "--budget=", 9))
+            {
+                if (0 == (params->budget = parseSize (argv[i] + 9)))
+                {
+                    fprintf (stderr, "Invalid budget %s\n", argv[i] + 9);
+                    return PARSE_ERROR;
+                }
+
+                continue;
+            }
+
+            if (0 == strncmp(argv[i], "--reset=", 8))
+            {
+                if (0 == strcmp(argv[i] + 8, "full"))
+                    params->resetPolicy = LZW_RESET_FULL;
+                else if (0 == strcmp(argv[i] + 8, "ratio"))
+                    params->resetPolicy = LZW_RESET_RATIO;
+                else if (0 == strcmp(argv[i] + 8, "window"))
+                    params->resetPolicy = LZW_RESET_WINDOW;
+                else
+                {
+                    fprintf (stderr, "Unknown reset policy %s\n", argv[i] + 8);
+                    return PARSE_ERROR;
+                }
+
+                flagReset = true;
+                continue;
+            }
+
+            if (0 == strcmp(argv[i], "--resume"))
+            {
+                flagResume = true;
+                continue;
+            }
+
+            if (0 == strncmp(argv[i], "--threads=", 10))
+            {
+                if ((params->workers = atoi (argv[i] + 10)) <= 0)
+                {
+                    fprintf (stderr, "Invalid thread count %s\n", argv[i] + 10);
+                    return PARSE_ERROR;
+                }
+
+                flagParallel = true;
+                continue;
+            }
+
             memset (combined_flags, 0, sizeof (combined_flags));
 
             strncpy (combined_flags, argv[i], sizeof (combined_flags) - 1);
@@ -158,6 +480,42 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
                 {
                     flagTest = true;
                 }
+                else if (flag == 'b')
+                {
+                    flagBlocked = true;
+                }
+                else if (flag == 'x')
+                {
+                    flagFast = true;
+                }
+                else if (flag == 'o')
+                {
+                    flagOverlap = true;
+                }
+                else if (flag == 'c')
+                {
+                    flagContinuous = true;
+                }
+                else if (flag == 'j')
+                {
+                    flagParallel = true;
+                }
+                else if (flag == 'e')
+                {
+                    flagEstimate = true;
+                }
+                else if (flag == 'a')
+                {
+                    flagAppend = true;
+                }
+                else if (flag == 's')
+                {
+                    flagSparse = true;
+                }
+                else if (flag == 'd')
+                {
+                    flagDedup = true;
+                }
                 else 
                 {
                     fprintf (stderr, "Unknown flag -%c\n", flag);
@@ -180,19 +538,19 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
         }
     }
 
-    if (flagTest + flagPack + flagUnpack > 1) /* inconsistent args */
+    if (flagTest + flagPack + flagUnpack + flagEstimate + flagAppend > 1) /* inconsistent args */
     {
-        fprintf (stderr, "Cannot combine -p, -u and -t flags.\n");
+        fprintf (stderr, "Cannot combine -p, -u, -t, -e and -a flags.\n");
         return PARSE_ERROR;
     }
 
-    if (flagTest + flagPack + flagUnpack == 0) 
+    if (flagTest + flagPack + flagUnpack + flagEstimate + flagAppend == 0) 
     {
         fprintf (stderr, "No pack, unpack or test flags given.\n");
         return PARSE_ERROR;
     }
 
-    if (flagTest)
+    if (flagTest || flagEstimate)
     {
       if (NULL == params->inputFile)
         return PARSE_ERROR;
@@ -206,8 +564,66 @@ static enum ArgOption parseArguments (int argc, char *argv[], struct progArgumen
     if (flagForce) params->flags |= OVERWRITE_FLAG;
     if (flagVerbose) params->flags |= VERBOSE_OUTPUT;
     if (flagKeepDirty) params->flags |= KEEP_ON_ERROR;
+    if (flagBlocked) params->flags |= BLOCKED_OUTPUT;
+    if (flagFast) params->flags |= FAST_MODE;
+    if (flagOverlap) params->overlap = true;
+    if (flagContinuous) params->flags |= CONTINUOUS_OUTPUT;
+    if (flagParallel) params->parallel = true;
+    if (flagSparse) params->flags |= SPARSE_OUTPUT;
+    if (flagDedup) params->flags |= DEDUP_OUTPUT;
+    if (flagResume) params->flags |= RESUMABLE_OUTPUT;
+
+    if (flagParallel && !flagUnpack)
+    {
+        fprintf (stderr, "-j and --threads apply to -u only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagSparse && !flagUnpack)
+    {
+        fprintf (stderr, "-s applies to -u only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagOverlap && !flagTest)
+    {
+        fprintf (stderr, "-o applies to -t only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagResume && !flagPack)
+    {
+        fprintf (stderr, "--resume applies to -p only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagReset && (!flagPack || flagBlocked))
+    {
+        fprintf (stderr, "--reset applies to -p without -b only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (params->resetPolicy != LZW_RESET_FULL && !flagContinuous)
+    {
+        fprintf (stderr, "--reset=ratio and --reset=window need -c.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagDedup && (!flagPack || flagBlocked || flagContinuous || flagResume || flagReset))
+    {
+        fprintf (stderr, "-d applies to -p without -b, -c, --resume or --reset only.\n");
+        return PARSE_ERROR;
+    }
+
+    if (flagBlocked && flagContinuous)
+    {
+        fprintf (stderr, "Cannot combine -b and -c flags.\n");
+        return PARSE_ERROR;
+    }
     
     if (flagTest) ret = FLAG_TEST;
+    else if (flagEstimate) ret = ESTIMATE;
+    else if (flagAppend) ret = FLAG_APPEND;
     else if (flagPack) ret = FLAG_PACK;
     else if (flagUnpack) ret = FLAG_UNPACK;
 
@@ -310,6 +726,8 @@ static void freeFilenames (struct progArguments * args)
 {
   free (args->inputFile);
   free (args->outputFile);
+  free (args->outputRing);
+  free (args->pattern);
 }
 
 /*--------------------------------------------------------------------*/
@@ -317,14 +735,16 @@ static void freeFilenames (struct progArguments * args)
 int main (int argc, char *argv[])
 {
   struct progArguments params;
+  struct lzwOptions options;
 
   int ret = EXIT_FAILURE;
 
-  const char temp_name [] = "lzw06_temp.lzw";
-  const char out_name [] = "lzw06_out.bin";
-
   enum ArgOption option = parseArguments (argc, argv, &params);
 
+  initOptions (&options, params.flags, params.bufferSize);
+  options.resetPolicy = params.resetPolicy;
+  signal (SIGINT, onInterrupt);
+
   if (option == PARSE_ERROR)
   {
     printSyntax ();
@@ -347,9 +767,37 @@ int main (int argc, char *argv[])
     return syntheticDataTest(kb256, SEQ_CONSTANT);
   }
 
+  else if (option == SERVE)
+  {
+    int workers = params.workers;
+
+#if defined(__linux__)
+    if (workers == 0)
+    {
+      workers = (int)sysconf (_SC_NPROCESSORS_ONLN);
+    }
+#endif
+
+    ret = RunServer (params.inputFile, workers > 0 ? workers : 1, params.flags);
+  }
+
+  else if (option == SHM_PACK)
+  {
+    if (0 == CompressRing(params.inputFile, params.outputRing, params.outputFile, &options))
+    {
+      printf ("Compression failed.\n");
+      ret = EXIT_FAILURE;
+    }
+    else
+    {
+      printf ("Compression successful.\n");
+      ret = EXIT_SUCCESS;
+    }
+  }
+
   else if (option == FLAG_PACK)
   {
-    if (0 == Compress(params.inputFile, params.outputFile, params.flags))
+    if (0 == CompressEx(params.inputFile, params.outputFile, &options))
     {
       printf ("Compression failed.\n");
       ret = EXIT_FAILURE;
@@ -360,9 +808,26 @@ int main (int argc, char *argv[])
       ret = EXIT_SUCCESS;
     }
   }
+  else if (option == FLAG_APPEND)
+  {
+    if (0 == AppendEx(params.inputFile, params.outputFile, &options))
+    {
+      printf ("Append failed.\n");
+      ret = EXIT_FAILURE;
+    }
+    else
+    {
+      printf ("Append successful.\n");
+      ret = EXIT_SUCCESS;
+    }
+  }
   else if (option == FLAG_UNPACK)
   {
-    if (0 == Decompress(params.inputFile, params.outputFile, params.flags))
+    int ok = params.parallel ?
+             DecompressParallelEx(params.inputFile, params.outputFile, &options, params.workers) :
+             DecompressEx(params.inputFile, params.outputFile, &options);
+
+    if (0 == ok)
     {
       printf ("Decompression failed.\n");
       ret = EXIT_FAILURE;
@@ -373,35 +838,47 @@ int main (int argc, char *argv[])
       ret = EXIT_SUCCESS;
     }
   }
-  else if (option == FLAG_TEST)
+  else if (option == SEARCH)
   {
-    if (0 == Compress(params.inputFile, temp_name, params.flags ))
+    unsigned long count = 0;
+
+    if (0 == SearchFile(params.inputFile, params.pattern, strlen (params.pattern), printHit, NULL, &count))
     {
-      printf ("Compression failed.\n");
-      freeFilenames (&params);
-      return EXIT_FAILURE;
+      printf ("Search failed.\n");
+      ret = EXIT_FAILURE;
     }
-    else 
+    else
     {
-      printf ("Compression successful.\n");
+      if (params.flags & VERBOSE_OUTPUT)
+      {
+        printf ("%lu matches.\n", count);
+      }
+
+      ret = (count > 0) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
+  }
+  else if (option == ESTIMATE)
+  {
+    double ratio;
 
-    if (0 == Decompress(temp_name, out_name, params.flags | OVERWRITE_FLAG))
+    if (0 == EstimateFileRatio(params.inputFile, params.budget, params.flags, &ratio))
     {
-      printf ("Decompression failed.\n");
-      freeFilenames (&params);
-      return EXIT_FAILURE;
+      printf ("Estimate failed.\n");
+      ret = EXIT_FAILURE;
     }
-    else 
+    else
     {
-      printf ("Decompression successful.\n");
+      printf ("%.4f\n", ratio);
+      ret = EXIT_SUCCESS;
     }
-
-    /* compare 2 files. */
-
-    run_cksum (params.inputFile);
-    run_cksum (out_name);
   }
+  else if (option == FLAG_TEST)
+  {
+    ret = RoundTripTest (params.inputFile, params.flags, params.overlap);
+  }
+
+  if (ret == EXIT_FAILURE && cancelRequested)
+    fprintf (stderr, "Cancelled.\n");
 
   freeFilenames (&params);
 
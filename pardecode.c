@@ -0,0 +1,510 @@
+/* Multithreaded unpacking of stream files (version 0 and
+   CONTINUOUS_VERSION). They have no index, but codes are a fixed 12 bits,
+   so every HT_CLEAR_CODE can be found without decoding, and the codes
+   between two of them only depend on each other. The file is mapped; a
+   sequential pass over string lengths places every segment in the
+   output, and the segments are then unpacked and expanded on separate
+   threads and written where they belong. No thread holds more than one
+   segment's codes. Progress is reported and the cancel flag checked
+   after every segment. */
+
+#define _GNU_SOURCE
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define NO_CODE     (-1)
+#define PLAN_BYTES  (3 * 8192)   /* packed bytes unpacked at a time while planning */
+
+struct segment
+{
+  size_t first, count;           /* code index and count, clear codes excluded */
+  unsigned long offset, length;  /* output */
+};
+
+struct parallelJob
+{
+  const uint8_t *packed;       /* codes after the header, mapped */
+  size_t packedLen;
+  struct segment *segments;
+  size_t segmentCount;
+  size_t next;         /* next segment to take; atomic */
+  int failed;          /* atomic */
+  int fd;
+  int sparse;          /* SPARSE_OUTPUT: the file starts as one hole */
+  size_t phraseBlock;  /* BUFFLEN for version 0 */
+  size_t writeSize;    /* bytes per pwrite, 0 for a whole segment */
+
+  pthread_mutex_t lock;
+  struct progressState ps;   /* guarded by lock */
+  int cancelled;             /* guarded by lock */
+};
+
+/*--------------------------------------------------------------------*/
+/* room for segments[n] */
+static int GrowSegments (struct segment **segments, size_t *capacity, size_t n)
+{
+  struct segment *grown;
+  size_t size = *capacity ? 2 * *capacity : 64;
+
+  if (n < *capacity)
+    return 1;
+
+  if (NULL == (grown = (struct segment *)realloc(*segments, size * sizeof(struct segment))))
+    return 0;
+
+  *segments = grown;
+  *capacity = size;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* Splits the packed codes at clear codes and computes where the output
+   of each segment goes. Only string lengths are tracked, but the
+   dictionary rules (including the version 0 phrase blocks, which depend
+   on the absolute position) are the same as in ExpandCode. The codes are
+   unpacked PLAN_BYTES at a time. *segments is allocated here. Returns
+   the number of segments, or 0 if the codes are corrupt. */
+static size_t PlanSegments (const uint8_t *packed, size_t len, size_t phraseBlock,
+                            struct segment **segments, unsigned long *total)
+{
+  const struct lzwKernels *kernels = GetKernels ();
+  uint16_t length[HT_MAX_CODE];
+  uint16_t *codes = (uint16_t *)malloc((UNPACKED_COUNT(PLAN_BYTES) + 1) * sizeof(uint16_t));
+  struct segment *seg = NULL;
+  int RunCode = 256, OldCode = NO_CODE, code, bytes, ended = false, ok = true;
+  unsigned long offset = 0;
+  size_t capacity = 0, pos, count, j, k = 0, n = 0;
+
+  for (j = 0; j < 256; j++)
+    length[j] = 1;
+
+  ok = codes && GrowSegments (&seg, &capacity, 0);
+
+  if (ok)
+  {
+    seg[0].first = 0;
+    seg[0].offset = 0;
+  }
+
+  for (pos = 0; ok && !ended && pos < len; pos += PLAN_BYTES)
+  {
+    count = kernels->unpack_codes (packed + pos, (len - pos < PLAN_BYTES) ? len - pos : PLAN_BYTES, codes);
+
+    for (j = 0; ok && j < count; j++, k++)
+    {
+      code = codes[j];
+
+      if (code == EOF_CODE)
+      {
+        ended = true;
+        break;
+      }
+
+      if (code == HT_CLEAR_CODE)
+      {
+        seg[n].count = k - seg[n].first;
+        seg[n].length = offset - seg[n].offset;
+
+        if (!(ok = GrowSegments (&seg, &capacity, ++n)))
+          break;
+
+        seg[n].first = k + 1;
+        seg[n].offset = offset;
+
+        RunCode = 256;
+        OldCode = NO_CODE;
+        continue;
+      }
+
+      if (code >= RunCode && (code > RunCode || OldCode == NO_CODE))
+        ok = false;
+
+      if (OldCode != NO_CODE && RunCode < HT_CLEAR_CODE)
+      {
+        length[RunCode++] = length[OldCode] + 1;
+      }
+
+      bytes = length[code];
+
+      if (phraseBlock && offset % phraseBlock + bytes > phraseBlock)
+        ok = false;
+
+      offset += bytes;
+      OldCode = code;
+
+      if (phraseBlock && offset % phraseBlock == 0)
+        OldCode = NO_CODE;
+    }
+  }
+
+  free (codes);
+
+  if (!ok || !ended)  /* corrupt, or no EOF_CODE */
+  {
+    free (seg);
+    return 0;
+  }
+
+  seg[n].count = k - seg[n].first;
+  seg[n].length = offset - seg[n].offset;
+
+  *segments = seg;
+  *total = offset;
+  return n + 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* pwrite in pieces of at most size bytes (0: all at once) */
+static int PutAt (int fd, const uint8_t *data, size_t len, unsigned long offset, size_t size)
+{
+  size_t n;
+
+  while (len > 0)
+  {
+    n = (size && size < len) ? size : len;
+
+    if ((ssize_t)n != pwrite (fd, data, n, offset))
+      return 0;
+
+    data += n;
+    offset += n;
+    len -= n;
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* PutAt, leaving out whole SPARSE_BLOCK blocks of zeros if sparse */
+static int WriteAt (int fd, const uint8_t *data, size_t len, unsigned long offset, int sparse,
+                    size_t size)
+{
+  size_t run = 0, n;
+
+  while (sparse && run < len)
+  {
+    n = SPARSE_BLOCK - (offset + run) % SPARSE_BLOCK;
+
+    if (n > len - run)
+      n = len - run;
+
+    if (n == SPARSE_BLOCK && IsZero (data + run, n))
+    {
+      if (!PutAt (fd, data, run, offset, size))
+        return 0;
+
+      data += run + n;
+      offset += run + n;
+      len -= run + n;
+      run = 0;
+    }
+    else
+      run += n;
+  }
+
+  return PutAt (fd, data, len, offset, size);
+}
+
+/*--------------------------------------------------------------------*/
+/* Adds a finished segment to the totals; 0 if the job was cancelled. */
+static int SegmentDone (struct parallelJob *job, size_t packed, unsigned long length)
+{
+  int ok;
+
+  pthread_mutex_lock (&job->lock);
+
+  ok = UpdateProgress (&job->ps, job->ps.bytesIn + packed, job->ps.bytesOut + length);
+
+  if (!ok)
+    job->cancelled = true;
+
+  pthread_mutex_unlock (&job->lock);
+
+  return ok;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void *DecodeSegments (void *arg)
+{
+  struct parallelJob *job = (struct parallelJob *)arg;
+  const struct lzwKernels *kernels = GetKernels ();
+  struct unpackHelper *uh = (struct unpackHelper *)malloc(sizeof(struct unpackHelper));
+  const struct segment *seg;
+  uint8_t *out = NULL, *grown;
+  uint16_t *codes = NULL, *more;
+  size_t cap = 0, codesCap = 0, from, to, i;
+
+  if (!uh)
+    __atomic_store_n (&job->failed, 1, __ATOMIC_RELAXED);
+
+  while (!__atomic_load_n (&job->failed, __ATOMIC_RELAXED))
+  {
+    i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED);
+
+    if (i >= job->segmentCount)
+      break;
+
+    seg = &job->segments[i];
+
+    if (seg->length > cap)
+    {
+      if (NULL == (grown = (uint8_t *)realloc(out, seg->length)))
+      {
+        __atomic_store_n (&job->failed, 1, __ATOMIC_RELAXED);
+        break;
+      }
+
+      out = grown;
+      cap = seg->length;
+    }
+
+    /* two codes per 3 bytes; an odd first code shares its bytes */
+    from = seg->first / 2 * 3;
+    to = (seg->first + seg->count + 1) / 2 * 3;
+
+    if (to > job->packedLen)
+      to = job->packedLen;
+
+    if (UNPACKED_COUNT(to - from) + 1 > codesCap)
+    {
+      if (NULL == (more = (uint16_t *)realloc(codes, (UNPACKED_COUNT(to - from) + 1) * sizeof(uint16_t))))
+      {
+        __atomic_store_n (&job->failed, 1, __ATOMIC_RELAXED);
+        break;
+      }
+
+      codes = more;
+      codesCap = UNPACKED_COUNT(to - from) + 1;
+    }
+
+    kernels->unpack_codes (job->packed + from, to - from, codes);
+
+    if (!ExpandSegment (uh, codes + seg->first % 2, seg->count, out, seg->length, seg->offset, job->phraseBlock)
+        || !WriteAt (job->fd, out, seg->length, seg->offset, job->sparse, job->writeSize)
+        || !SegmentDone (job, to - from, seg->length))
+    {
+      __atomic_store_n (&job->failed, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  free (out);
+  free (codes);
+  free (uh);
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+/* the whole file, read only; NULL on error */
+static uint8_t *MapFile (FILE *fp, size_t *size)
+{
+  struct stat st;
+  void *p;
+
+  if (fstat (fileno (fp), &st) != 0 || st.st_size < HEADER_SIZE)
+    return NULL;
+
+  p = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+
+  if (p == MAP_FAILED)
+    return NULL;
+
+  *size = st.st_size;
+
+  return (uint8_t *)p;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int RunJob (struct parallelJob *job, int threads)
+{
+  pthread_t *ids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+  int started;
+
+  if (!ids)
+    return 0;
+
+  for (started = 0; started < threads; started++)
+  {
+    if (pthread_create (&ids[started], NULL, DecodeSegments, job) != 0)
+      break;
+  }
+
+  if (started == 0)
+    DecodeSegments (job);
+
+  while (started > 0)
+    pthread_join (ids[--started], NULL);
+
+  free (ids);
+
+  return !job->failed;
+}
+
+/*--------------------------------------------------------------------*/
+
+int DecompressParallel (const char *filename, const char *outfile, int flags, int threads)
+{
+  struct lzwOptions options;
+
+  memset (&options, 0, sizeof(options));
+  options.flags = flags;
+
+  return DecompressParallelEx (filename, outfile, &options, threads);
+}
+
+/*--------------------------------------------------------------------*/
+
+int DecompressParallelEx (const char *filename, const char *outfile, const struct lzwOptions *options,
+                          int threads)
+{
+  FILE *fp;
+  struct lzwHeader hdr;
+  struct parallelJob job;
+  uint8_t *map;
+  struct segment *segments = NULL;
+  size_t mapSize = 0;
+  unsigned long total = 0;
+  int unpack_ok = false, flags = options->flags;
+
+  if (is_big_endian())
+  {
+    fprintf (stderr, "Not supported on big endian machines.\n");
+    return 0;
+  }
+
+  if (!(flags & OVERWRITE_FLAG) && file_exists(outfile))
+  {
+    fprintf (stderr, "File \'%s\' already exists. Use overwrite flag.\n", outfile);
+    return 0;
+  }
+
+  fp = fopen(filename, "rb");
+
+  if (NULL == fp)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  if (!ReadHeader (fp, &hdr))
+  {
+    fclose (fp);
+    return 0;
+  }
+
+  /* frames are not split further */
+  if (hdr.version == FRAMED_VERSION || hdr.version == DEDUP_VERSION)
+  {
+    fclose (fp);
+    return DecompressEx (filename, outfile, options);
+  }
+
+  map = MapFile (fp, &mapSize);
+  fclose (fp);
+
+  if (!map)
+  {
+    fprintf (stderr, "Cannot read file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  memset (&job, 0, sizeof(job));
+  job.packed = map + HEADER_SIZE;
+  job.packedLen = mapSize - HEADER_SIZE;
+  job.phraseBlock = (hdr.version == PACKER_VERSION) ? BUFFLEN : 0;
+  job.sparse = (flags & SPARSE_OUTPUT) ? 1 : 0;
+  job.writeSize = options->bufferSize;
+  job.segmentCount = PlanSegments (job.packed, job.packedLen, job.phraseBlock, &segments, &total);
+  job.segments = segments;
+
+  if (job.segmentCount == 0 || total != hdr.inputSize)
+  {
+    fprintf (stderr, "Corrupt input.\n");
+    free (segments);
+    munmap (map, mapSize);
+    return 0;
+  }
+
+  if (threads <= 0)
+    threads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (threads <= 0 || (size_t)threads > job.segmentCount)
+    threads = (int)job.segmentCount;
+
+  if (flags & VERBOSE_OUTPUT)
+  {
+    printf ("expected output size: %ld, %ld segments on %d threads.\n",
+            (long)hdr.inputSize, (long)job.segmentCount, threads);
+  }
+
+  job.fd = open (outfile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (job.fd < 0)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", outfile);
+    perror (NULL);
+  }
+  else
+  {
+    pthread_mutex_init (&job.lock, NULL);
+    InitProgress (&job.ps, options, total, true);
+
+    unpack_ok = (0 == ftruncate (job.fd, total)) && RunJob (&job, threads);
+
+    if (unpack_ok)
+      FinishProgress (&job.ps);
+    else if (!job.cancelled)
+      fprintf (stderr, "Write error or corrupt input.\n");
+
+    pthread_mutex_destroy (&job.lock);
+
+    if (0 != close (job.fd))
+    {
+      fprintf (stderr, "Write error. Out of disk space?\n");
+      unpack_ok = false;
+    }
+
+    if (!unpack_ok)
+      cleanup (outfile, flags);
+  }
+
+  free (segments);
+  munmap (map, mapSize);
+
+  return unpack_ok ? 1 : 0;
+}
+
+#else
+
+int DecompressParallel (const char *filename, const char *outfile, int flags, int threads)
+{
+  (void)threads;
+  return Decompress (filename, outfile, flags);
+}
+
+int DecompressParallelEx (const char *filename, const char *outfile, const struct lzwOptions *options,
+                          int threads)
+{
+  (void)threads;
+  return DecompressEx (filename, outfile, options);
+}
+
+#endif
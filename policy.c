@@ -0,0 +1,128 @@
+/* Dictionary reset policies for the stream formats. Apart from
+   LZW_RESET_FULL the encoder keeps a full dictionary (encodeState.freeze)
+   and the packer asks WantReset at the end of every RESET_WINDOW bytes
+   of input whether to write HT_CLEAR_CODE there. Ratios are codes per
+   input byte, so lower is better. */
+
+#include "codec.h"
+
+#include <string.h>
+
+/* the fill phase ratio includes the cost of growing the dictionary, so
+   a full one that is not clearly better is not worth keeping */
+#define WINDOW_SLACK   0.90
+#define PHASE_SLACK    1.50
+
+/*--------------------------------------------------------------------*/
+
+void InitResetMonitor (struct resetMonitor *m, int policy)
+{
+  memset (m, 0, sizeof(*m));
+  m->policy = policy;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Restart (struct resetMonitor *m)
+{
+  m->sinceBytes = m->sinceCodes = 0;
+  m->recentCount = 0;
+  m->best = m->fill = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void MonitorBlock (struct resetMonitor *m, unsigned long bytes, unsigned long codes, int full)
+{
+  m->bytes += bytes;
+  m->codes += codes;
+
+  if (full && m->policy != LZW_RESET_FULL)
+    m->stats.frozenBytes += bytes;
+}
+
+/*--------------------------------------------------------------------*/
+
+int WantReset (struct resetMonitor *m, int full)
+{
+  unsigned long bytes = m->bytes, codes = m->codes;
+  double r;
+  int i, reset = 0;
+
+  m->bytes = m->codes = 0;
+  m->sinceBytes += bytes;
+  m->sinceCodes += codes;
+
+  for (i = RECENT_WINDOWS - 1; i > 0; i--)
+  {
+    m->recentBytes[i] = m->recentBytes[i - 1];
+    m->recentCodes[i] = m->recentCodes[i - 1];
+  }
+
+  m->recentBytes[0] = bytes;
+  m->recentCodes[0] = codes;
+
+  if (m->recentCount < RECENT_WINDOWS)
+    m->recentCount++;
+
+  if (m->policy == LZW_RESET_RATIO)
+  {
+    /* Unix compress: once the dictionary is full, clear it as soon as the
+       ratio since the last reset stops improving */
+    if (!full)
+      return 0;
+
+    r = (double)m->sinceCodes / m->sinceBytes;
+
+    if (m->best == 0 || r <= m->best)
+      m->best = r;
+    else
+      reset = 1;
+  }
+  else if (m->policy == LZW_RESET_WINDOW)
+  {
+    for (bytes = codes = 0, i = 0; i < m->recentCount; i++)
+    {
+      bytes += m->recentBytes[i];
+      codes += m->recentCodes[i];
+    }
+
+    r = (double)codes / bytes;
+
+    if (!full)
+    {
+      /* the data changed under a dictionary that is still growing */
+      if (m->best == 0 || r < m->best)
+        m->best = r;
+      else
+        reset = (m->recentCount == RECENT_WINDOWS && r > m->best * PHASE_SLACK);
+    }
+    else if (m->fill == 0)
+    {
+      /* what a fresh dictionary gave, filling up */
+      m->fill = (double)m->sinceCodes / m->sinceBytes;
+    }
+    else
+    {
+      /* the full dictionary does little better than a fresh one did */
+      reset = (r > m->fill * WINDOW_SLACK);
+    }
+  }
+
+  if (reset)
+  {
+    m->stats.resets++;
+    m->stats.earlyResets += !full;
+    Restart (m);
+  }
+
+  return reset;
+}
+
+/*--------------------------------------------------------------------*/
+/* the kernel cleared a full dictionary by itself (LZW_RESET_FULL) */
+void MonitorClear (struct resetMonitor *m)
+{
+  m->stats.resets++;
+  Restart (m);
+}
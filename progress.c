@@ -0,0 +1,94 @@
+/* Progress callback and cancellation for CompressEx/DecompressEx. */
+
+#if defined(__linux__)
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#endif
+
+#include "codec.h"
+
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_INTERVAL  (1UL << 20)
+
+/*--------------------------------------------------------------------*/
+
+double WallSeconds (void)
+{
+#if defined(__linux__)
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double)clock () / CLOCKS_PER_SEC;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+void InitProgress (struct progressState *ps, const struct lzwOptions *options,
+                   unsigned long total, int decoding)
+{
+  memset (ps, 0, sizeof(*ps));
+
+  ps->options = options;
+  ps->total = total;
+  ps->decoding = decoding;
+  ps->interval = (options && options->interval) ? options->interval : DEFAULT_INTERVAL;
+  ps->nextReport = ps->interval;
+  ps->start = ps->last = WallSeconds ();
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Report (struct progressState *ps)
+{
+  struct lzwProgress p;
+  double now = WallSeconds ();
+  unsigned long raw = ps->decoding ? ps->bytesOut : ps->bytesIn;
+
+  p.bytesIn = ps->bytesIn;
+  p.bytesOut = ps->bytesOut;
+  p.total = ps->total;
+  p.seconds = now - ps->start;
+  p.mbPerSec = (now > ps->last) ? (raw - ps->lastRaw) / (now - ps->last) / 1e6 : 0.0;
+
+  ps->last = now;
+  ps->lastRaw = raw;
+
+  ps->options->progress (&p, ps->options->user);
+}
+
+/*--------------------------------------------------------------------*/
+
+int UpdateProgress (struct progressState *ps, unsigned long bytesIn, unsigned long bytesOut)
+{
+  const struct lzwOptions *options = ps->options;
+
+  ps->bytesIn = bytesIn;
+  ps->bytesOut = bytesOut;
+
+  if (options == NULL)
+    return 1;
+
+  if (options->cancel && *options->cancel)
+    return 0;
+
+  if (options->progress && (ps->decoding ? bytesOut : bytesIn) >= ps->nextReport)
+  {
+    Report (ps);
+    ps->nextReport = (ps->decoding ? bytesOut : bytesIn) + ps->interval;
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void FinishProgress (struct progressState *ps)
+{
+  if (ps->options && ps->options->progress)
+    Report (ps);
+}
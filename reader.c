@@ -0,0 +1,363 @@
+/* Random access to framed files. Every frame is decoded on its own, so
+   a read only needs the frames it overlaps. Decoded frames are kept in
+   an LRU cache shared by all threads using the reader. */
+
+#define _GNU_SOURCE
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define DEFAULT_CACHE_BLOCKS  16
+
+struct frameIndex
+{
+  unsigned long rawOffset;
+  uint32_t rawSize;
+  uint32_t packedSize;
+  long fileOffset;     /* of the packed codes */
+};
+
+struct cacheEntry
+{
+  size_t frame;
+  uint8_t *data;
+  struct cacheEntry *prev, *next;   /* most recently used first */
+};
+
+struct lzwReader
+{
+  int fd;
+  const struct lzwKernels *kernels;
+
+  struct frameIndex *frames;
+  size_t frameCount;
+  unsigned long size;
+
+  pthread_mutex_t lock;             /* everything below */
+  struct cacheEntry **cached;       /* by frame, NULL if not cached */
+  struct cacheEntry *head, *tail;
+  size_t entries, capacity;
+  unsigned long hits, misses;
+};
+
+/*--------------------------------------------------------------------*/
+/* Walks the frame headers; the payloads are not read. */
+static int BuildIndex (struct lzwReader *r, uint32_t inputSize)
+{
+  uint8_t header[FRAME_HEADER_SIZE];
+  struct frameIndex *grown;
+  size_t cap = 0;
+  long pos = HEADER_SIZE;
+  ssize_t len;
+
+  while ((len = pread (r->fd, header, FRAME_HEADER_SIZE, pos)) != 0)
+  {
+    if (len != FRAME_HEADER_SIZE)
+      return 0;
+
+    if (r->frameCount == cap)
+    {
+      cap = cap ? 2 * cap : 64;
+
+      if (NULL == (grown = (struct frameIndex *)realloc(r->frames, cap * sizeof(struct frameIndex))))
+        return 0;
+
+      r->frames = grown;
+    }
+
+    r->frames[r->frameCount].rawOffset = r->size;
+    r->frames[r->frameCount].rawSize = get_u32 (header);
+    r->frames[r->frameCount].packedSize = get_u32 (header + 4);
+    r->frames[r->frameCount].fileOffset = pos + FRAME_HEADER_SIZE;
+
+    if (r->frames[r->frameCount].packedSize > FRAME_BOUND(r->frames[r->frameCount].rawSize))
+      return 0;
+
+    r->size += r->frames[r->frameCount].rawSize;
+    pos += FRAME_HEADER_SIZE + r->frames[r->frameCount].packedSize;
+    r->frameCount++;
+  }
+
+  return r->size == inputSize;
+}
+
+/*--------------------------------------------------------------------*/
+
+struct lzwReader *OpenReader (const char *filename, size_t cacheBlocks)
+{
+  struct lzwReader *r;
+  struct lzwHeader hdr;
+  uint8_t header[HEADER_SIZE];
+  int fd = open (filename, O_RDONLY);
+
+  if (fd < 0)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", filename);
+    perror (NULL);
+    return NULL;
+  }
+
+  if (!ParseHeader (header, pread (fd, header, HEADER_SIZE, 0) == HEADER_SIZE ? HEADER_SIZE : 0, &hdr))
+  {
+    close (fd);
+    return NULL;
+  }
+
+  if (hdr.version != FRAMED_VERSION)
+  {
+    fprintf (stderr, "Random access needs a framed (-b) file.\n");
+    close (fd);
+    return NULL;
+  }
+
+  if (NULL == (r = (struct lzwReader *)calloc(1, sizeof(struct lzwReader))))
+  {
+    close (fd);
+    return NULL;
+  }
+
+  r->fd = fd;
+  r->kernels = GetKernels ();
+  r->capacity = cacheBlocks ? cacheBlocks : DEFAULT_CACHE_BLOCKS;
+
+  if (!BuildIndex (r, hdr.inputSize)
+      || NULL == (r->cached = (struct cacheEntry **)calloc(r->frameCount + 1, sizeof(struct cacheEntry *))))
+  {
+    fprintf (stderr, "Corrupt input.\n");
+    free (r->frames);
+    free (r);
+    close (fd);
+    return NULL;
+  }
+
+  pthread_mutex_init (&r->lock, NULL);
+
+  return r;
+}
+
+/*--------------------------------------------------------------------*/
+
+void CloseReader (struct lzwReader *r)
+{
+  struct cacheEntry *e, *next;
+
+  if (r == NULL)
+    return;
+
+  for (e = r->head; e != NULL; e = next)
+  {
+    next = e->next;
+    free (e->data);
+    free (e);
+  }
+
+  pthread_mutex_destroy (&r->lock);
+  close (r->fd);
+  free (r->cached);
+  free (r->frames);
+  free (r);
+}
+
+/*--------------------------------------------------------------------*/
+
+unsigned long ReaderSize (const struct lzwReader *r)
+{
+  return r->size;
+}
+
+/*--------------------------------------------------------------------*/
+
+void ReaderStats (struct lzwReader *r, unsigned long *hits, unsigned long *misses)
+{
+  pthread_mutex_lock (&r->lock);
+  *hits = r->hits;
+  *misses = r->misses;
+  pthread_mutex_unlock (&r->lock);
+}
+
+/*--------------------------------------------------------------------*/
+/* list helpers; called with the lock held */
+
+static void Unlink (struct lzwReader *r, struct cacheEntry *e)
+{
+  if (e->prev) e->prev->next = e->next; else r->head = e->next;
+  if (e->next) e->next->prev = e->prev; else r->tail = e->prev;
+}
+
+static void PushFront (struct lzwReader *r, struct cacheEntry *e)
+{
+  e->prev = NULL;
+  e->next = r->head;
+
+  if (r->head) r->head->prev = e; else r->tail = e;
+
+  r->head = e;
+}
+
+/*--------------------------------------------------------------------*/
+/* Decodes one frame into a new entry, without the lock. */
+static struct cacheEntry *LoadFrame (struct lzwReader *r, size_t frame)
+{
+  const struct frameIndex *f = &r->frames[frame];
+  struct cacheEntry *e = (struct cacheEntry *)malloc(sizeof(struct cacheEntry));
+  uint8_t *packed = (uint8_t *)malloc(f->packedSize + 1);
+  uint16_t *codes = (uint16_t *)malloc((UNPACKED_COUNT(f->packedSize) + 1) * sizeof(uint16_t));
+  struct unpackHelper *uh = (struct unpackHelper *)malloc(sizeof(struct unpackHelper));
+  int ok;
+
+  ok = e && packed && codes && uh && (e->data = (uint8_t *)malloc(f->rawSize + 1)) != NULL;
+
+  ok = ok && (ssize_t)f->packedSize == pread (r->fd, packed, f->packedSize, f->fileOffset) &&
+       DecodeCodes (r->kernels, uh, packed, f->packedSize, codes, e->data, f->rawSize, 0);
+
+  if (!ok && e)
+  {
+    free (e->data);
+    free (e);
+    e = NULL;
+  }
+
+  if (e)
+    e->frame = frame;
+
+  free (packed);
+  free (codes);
+  free (uh);
+
+  return e;
+}
+
+/*--------------------------------------------------------------------*/
+/* Copies up to len bytes of frame starting at skip into out. */
+static int ReadFrame (struct lzwReader *r, size_t frame, size_t skip, uint8_t *out, size_t len)
+{
+  struct cacheEntry *e, *loaded;
+
+  pthread_mutex_lock (&r->lock);
+
+  if ((e = r->cached[frame]) != NULL)
+  {
+    r->hits++;
+    Unlink (r, e);
+    PushFront (r, e);
+    memcpy (out, e->data + skip, len);
+    pthread_mutex_unlock (&r->lock);
+    return 1;
+  }
+
+  r->misses++;
+  pthread_mutex_unlock (&r->lock);
+
+  /* other threads keep reading while this frame is decoded */
+  if (NULL == (loaded = LoadFrame (r, frame)))
+    return 0;
+
+  pthread_mutex_lock (&r->lock);
+
+  /* another thread may have loaded it meanwhile */
+  if ((e = r->cached[frame]) != NULL)
+  {
+    Unlink (r, e);
+    free (loaded->data);
+    free (loaded);
+  }
+  else
+  {
+    e = loaded;
+    r->cached[frame] = e;
+    r->entries++;
+
+    if (r->entries > r->capacity)
+    {
+      struct cacheEntry *old = r->tail;
+
+      Unlink (r, old);
+      r->cached[old->frame] = NULL;
+      r->entries--;
+      free (old->data);
+      free (old);
+    }
+  }
+
+  PushFront (r, e);
+  memcpy (out, e->data + skip, len);
+  pthread_mutex_unlock (&r->lock);
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+long ReaderRead (struct lzwReader *r, void *buf, size_t len, unsigned long offset)
+{
+  uint8_t *out = (uint8_t *)buf;
+  size_t lo = 0, hi = r->frameCount, mid, skip, n, done = 0;
+
+  if (offset >= r->size)
+    return 0;
+
+  if (len > r->size - offset)
+    len = r->size - offset;
+
+  /* last frame starting at or before offset */
+  while (hi - lo > 1)
+  {
+    mid = (lo + hi) / 2;
+
+    if (r->frames[mid].rawOffset <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  for (; done < len; lo++)
+  {
+    skip = offset + done - r->frames[lo].rawOffset;
+    n = r->frames[lo].rawSize - skip;
+
+    if (n > len - done)
+      n = len - done;
+
+    if (n > 0 && !ReadFrame (r, lo, skip, out + done, n))
+      return -1;
+
+    done += n;
+  }
+
+  return (long)done;
+}
+
+#else
+
+struct lzwReader *OpenReader (const char *filename, size_t cacheBlocks)
+{
+  (void)filename;
+  (void)cacheBlocks;
+  fprintf (stderr, "Random access reader is not available on this platform.\n");
+  return NULL;
+}
+
+void CloseReader (struct lzwReader *r) { (void)r; }
+unsigned long ReaderSize (const struct lzwReader *r) { (void)r; return 0; }
+long ReaderRead (struct lzwReader *r, void *buf, size_t len, unsigned long offset)
+{
+  (void)r; (void)buf; (void)len; (void)offset;
+  return -1;
+}
+void ReaderStats (struct lzwReader *r, unsigned long *hits, unsigned long *misses)
+{
+  (void)r;
+  *hits = *misses = 0;
+}
+
+#endif
@@ -0,0 +1,335 @@
+/* In-memory round trip test. No temporary files; only the input is read
+   from disk, and that time is reported separately. */
+
+#define _GNU_SOURCE
+
+#include "roundtrip.h"
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+
+/* overlap unit: one CompressBuffer call per 4 frames */
+#define CHUNK_SIZE  (4 * FRAME_SIZE)
+
+struct roundTrip
+{
+  const uint8_t *input;
+  size_t size;
+  uint8_t *packed;
+  uint8_t *output;
+  size_t packedSize;     /* as a single file would be */
+  double packTime, unpackTime;
+  int flags;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Reads to the end of the file, so pipes work as well as regular files. */
+static uint8_t *ReadInput (const char *filename, size_t *size)
+{
+  FILE *fp = fopen (filename, "rb");
+  uint8_t *data, *grown;
+  size_t len = 0, cap = IO_BUFFLEN, n;
+
+  if (fp == NULL)
+  {
+    fprintf (stderr, "Cannot open input file \'%s\'.\n", filename);
+    perror (NULL);
+    return NULL;
+  }
+
+  data = (uint8_t *)malloc(cap);
+
+  while (data != NULL && (n = fread (data + len, 1, cap - len, fp)) > 0)
+  {
+    len += n;
+
+    if (len == cap)
+    {
+      grown = (uint8_t *)realloc(data, 2 * cap);
+
+      if (grown == NULL)
+      {
+        free (data);
+        data = NULL;
+        break;
+      }
+
+      data = grown;
+      cap *= 2;
+    }
+  }
+
+  if (data == NULL || ferror (fp))
+  {
+    fprintf (stderr, "Cannot read input file \'%s\'.\n", filename);
+    free (data);
+    data = NULL;
+  }
+
+  fclose (fp);
+  *size = len;
+
+  return data;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int RunSequential (struct roundTrip *rt)
+{
+  struct lzwContext *ctx = CreateContext (rt->flags);
+  size_t produced = 0;
+  double start;
+  int ok;
+
+  if (ctx == NULL)
+    return 0;
+
+  start = WallSeconds ();
+  ok = CompressBuffer (ctx, rt->input, rt->size, rt->packed, CompressBound (rt->size), &rt->packedSize);
+  rt->packTime = WallSeconds () - start;
+
+  if (!ok)
+  {
+    fprintf (stderr, "Compression failed.\n");
+  }
+  else
+  {
+    start = WallSeconds ();
+    ok = DecompressBuffer (ctx, rt->packed, rt->packedSize, rt->output, rt->size, &produced) &&
+         produced == rt->size;
+    rt->unpackTime = WallSeconds () - start;
+
+    if (!ok)
+      fprintf (stderr, "Decompression failed.\n");
+  }
+
+  FreeContext (ctx);
+
+  return ok;
+}
+
+#if defined(__linux__)
+
+/*--------------------------------------------------------------------*/
+/* Chunks are independent framed images, so chunk i can be decoded as
+   soon as it is written. ready counts finished chunks, -1 on error. */
+struct overlapState
+{
+  struct roundTrip *rt;
+  size_t chunks;
+  size_t *sizes;
+  long ready;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+static void Publish (struct overlapState *os, long ready)
+{
+  pthread_mutex_lock (&os->lock);
+  os->ready = ready;
+  pthread_cond_signal (&os->cond);
+  pthread_mutex_unlock (&os->lock);
+}
+
+static void *PackChunks (void *arg)
+{
+  struct overlapState *os = (struct overlapState *)arg;
+  struct roundTrip *rt = os->rt;
+  struct lzwContext *ctx = CreateContext (rt->flags);
+  size_t i, len, bound = CompressBound (CHUNK_SIZE);
+  double start;
+
+  if (ctx == NULL)
+  {
+    Publish (os, -1);
+    return NULL;
+  }
+
+  for (i = 0; i < os->chunks; i++)
+  {
+    len = (i + 1 < os->chunks) ? CHUNK_SIZE : rt->size - i * CHUNK_SIZE;
+
+    start = WallSeconds ();
+
+    if (!CompressBuffer (ctx, rt->input + i * CHUNK_SIZE, len, rt->packed + i * bound, bound, &os->sizes[i]))
+    {
+      Publish (os, -1);
+      break;
+    }
+
+    rt->packTime += WallSeconds () - start;
+
+    Publish (os, (long)i + 1);
+  }
+
+  FreeContext (ctx);
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int RunOverlapped (struct roundTrip *rt)
+{
+  struct overlapState os;
+  struct lzwContext *ctx = CreateContext (rt->flags);
+  pthread_t packer;
+  size_t i, len, produced, bound = CompressBound (CHUNK_SIZE);
+  double start;
+  int ok = (ctx != NULL);
+
+  os.rt = rt;
+  os.chunks = (rt->size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  os.sizes = (size_t *)calloc(os.chunks + 1, sizeof(size_t));
+  os.ready = 0;
+  pthread_mutex_init (&os.lock, NULL);
+  pthread_cond_init (&os.cond, NULL);
+
+  if (!ok || os.sizes == NULL || pthread_create (&packer, NULL, PackChunks, &os) != 0)
+  {
+    perror (NULL);
+    FreeContext (ctx);
+    free (os.sizes);
+    return 0;
+  }
+
+  rt->packedSize = HEADER_SIZE;
+
+  for (i = 0; i < os.chunks && ok; i++)
+  {
+    pthread_mutex_lock (&os.lock);
+
+    while (os.ready >= 0 && os.ready <= (long)i)
+      pthread_cond_wait (&os.cond, &os.lock);
+
+    ok = os.ready > (long)i;
+    pthread_mutex_unlock (&os.lock);
+
+    if (!ok)
+    {
+      fprintf (stderr, "Compression failed.\n");
+      break;
+    }
+
+    len = (i + 1 < os.chunks) ? CHUNK_SIZE : rt->size - i * CHUNK_SIZE;
+
+    start = WallSeconds ();
+    ok = DecompressBuffer (ctx, rt->packed + i * bound, os.sizes[i], rt->output + i * CHUNK_SIZE, len, &produced) &&
+         produced == len;
+    rt->unpackTime += WallSeconds () - start;
+
+    if (!ok)
+      fprintf (stderr, "Decompression failed.\n");
+
+    rt->packedSize += os.sizes[i] - HEADER_SIZE;
+  }
+
+  pthread_join (packer, NULL);
+
+  pthread_mutex_destroy (&os.lock);
+  pthread_cond_destroy (&os.cond);
+  FreeContext (ctx);
+  free (os.sizes);
+
+  return ok;
+}
+
+#endif
+
+/*--------------------------------------------------------------------*/
+
+static double Rate (size_t bytes, double seconds)
+{
+  return (seconds > 0) ? bytes / seconds / 1e6 : 0.0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int RoundTripTest (const char *filename, int flags, int overlap)
+{
+  struct roundTrip rt;
+  size_t chunks, packedCap, i;
+  double start, readTime, wall;
+  int ok;
+
+  memset (&rt, 0, sizeof(rt));
+  rt.flags = flags;
+
+#if defined(__linux__)
+  if (overlap)
+    rt.flags |= BLOCKED_OUTPUT; /* chunks must be independent */
+#else
+  overlap = false;
+#endif
+
+  start = WallSeconds ();
+  rt.input = ReadInput (filename, &rt.size);
+  readTime = WallSeconds () - start;
+
+  if (rt.input == NULL)
+    return EXIT_FAILURE;
+
+  chunks = (rt.size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  packedCap = overlap ? chunks * CompressBound (CHUNK_SIZE) : CompressBound (rt.size);
+
+  rt.packed = (uint8_t *)malloc(packedCap > 0 ? packedCap : 1);
+  rt.output = (uint8_t *)malloc(rt.size > 0 ? rt.size : 1);
+
+  if (!rt.packed || !rt.output)
+  {
+    perror (NULL);
+    free ((void *)rt.input); free (rt.packed); free (rt.output);
+    return EXIT_FAILURE;
+  }
+
+  start = WallSeconds ();
+
+#if defined(__linux__)
+  ok = overlap ? RunOverlapped (&rt) : RunSequential (&rt);
+#else
+  ok = RunSequential (&rt);
+#endif
+
+  wall = WallSeconds () - start;
+
+  if (ok)
+  {
+    for (i = 0; i < rt.size && rt.input[i] == rt.output[i]; i++)
+      ;
+
+    if (i < rt.size)
+    {
+      fprintf (stderr, "Round trip MISMATCH at byte %lu.\n", (unsigned long)i);
+      ok = false;
+    }
+  }
+
+  printf ("Read    : %lu bytes in %.3f s\n", (unsigned long)rt.size, readTime);
+
+  if (ok)
+  {
+    printf ("Pack    : %.3f s, %.1f MB/s, %lu bytes, ratio %.2f%%\n", rt.packTime,
+            Rate (rt.size, rt.packTime), (unsigned long)rt.packedSize,
+            rt.size ? 100.0 * ((double)rt.size - rt.packedSize) / rt.size : 0.0);
+    printf ("Unpack  : %.3f s, %.1f MB/s\n", rt.unpackTime, Rate (rt.size, rt.unpackTime));
+
+    if (overlap)
+      printf ("Overlap : %.3f s wall, %.1f MB/s\n", wall, Rate (rt.size, wall));
+
+    printf ("Round trip identical.\n");
+  }
+
+  free ((void *)rt.input);
+  free (rt.packed);
+  free (rt.output);
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+/* lzw06 -t: compresses and decompresses a file in memory and compares
+   the result. With overlap (-o, framed output only) decompression runs
+   on a second thread while later chunks are still being compressed.
+   Returns EXIT_SUCCESS if the round trip reproduced the input. */
+
+int RoundTripTest (const char *filename, int flags, int overlap);
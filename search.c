@@ -0,0 +1,409 @@
+/* Pattern search in compressed images without rebuilding the output:
+   bit-parallel Shift-And run over the LZW codes (after Navarro and
+   Raffinot). Next to the dictionary every string S keeps what the matcher
+   needs to step over all of S at once, so a code costs the same whatever
+   the length of its string. */
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define SEARCH_CHUNK  (3 * 16384)   /* packed bytes per step; must be divisible by 3 */
+#define NO_CODE       (-1)
+
+enum { SEARCH_CORRUPT = -1, SEARCH_MORE = 0, SEARCH_EOF = 1 };
+
+struct searchState
+{
+  const struct lzwKernels *kernels;
+
+  /* Shift-And over the pattern: bit j of the state is set when the text
+     so far ends with pattern[0..j] */
+  uint64_t mask[256];
+  uint64_t top;        /* bit of the last pattern byte */
+  int m;
+
+  /* per dictionary string S */
+  uint64_t inner[HT_MAX_CODE];    /* state after S with nothing before it */
+  uint64_t through[HT_MAX_CODE];  /* bits j with pattern[j-|S|+1..j] == S */
+  uint64_t exits[HT_MAX_CODE];    /* bits j with pattern[j+1..] a proper prefix of S */
+  int16_t lastHit[HT_MAX_CODE];   /* longest prefix of S (S included) that ends with the pattern */
+  int16_t prefix[HT_MAX_CODE];
+  uint16_t length[HT_MAX_CODE];
+  uint8_t first[HT_MAX_CODE];
+  int16_t RunCode;
+  int16_t OldCode;
+
+  uint64_t state;
+  unsigned long offset;    /* uncompressed bytes searched */
+  unsigned long count;
+  size_t phraseBlock;      /* BUFFLEN for version 0 streams */
+  lzwHitFn hit;
+  void *user;
+
+  unsigned long inside[HT_MAX_CODE];
+  uint16_t codes[UNPACKED_COUNT(SEARCH_CHUNK)];
+};
+
+/* a compressed image read in pieces from a file or from memory */
+struct searchSource
+{
+  FILE *fp;
+  const uint8_t *data;
+  size_t size, pos;
+  uint8_t *buffer;     /* SEARCH_CHUNK bytes when reading a file */
+};
+
+/*--------------------------------------------------------------------*/
+
+static void ResetDictionary (struct searchState *s)
+{
+  s->RunCode = 256;
+  s->OldCode = NO_CODE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void InitSearch (struct searchState *s, const uint8_t *pattern, int len)
+{
+  int i;
+
+  memset (s->mask, 0, sizeof(s->mask));
+
+  for (i = 0; i < len; i++)
+  {
+    s->mask[pattern[i]] |= (uint64_t)1 << i;
+  }
+
+  s->m = len;
+  s->top = (uint64_t)1 << (len - 1);
+
+  for (i = 0; i < 256; i++)
+  {
+    s->inner[i] = s->mask[i] & 1;
+    s->through[i] = s->mask[i];
+    s->exits[i] = (len > 1 && (s->mask[i] & s->top)) ? (uint64_t)1 << (len - 2) : 0;
+    s->lastHit[i] = (s->inner[i] & s->top) ? i : NO_CODE;  /* one byte pattern */
+    s->prefix[i] = NO_CODE;
+    s->length[i] = 1;
+    s->first[i] = (uint8_t)i;
+  }
+
+  ResetDictionary (s);
+
+  s->kernels = GetKernels ();
+  s->state = 0;
+  s->offset = 0;
+  s->count = 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* new string: string of code p followed by byte c */
+static void AddString (struct searchState *s, int p, int c)
+{
+  int n = s->RunCode++;
+  int len = s->length[p] + 1;
+  uint64_t through = (s->through[p] << 1) & s->mask[c];
+
+  s->inner[n] = ((s->inner[p] << 1) | 1) & s->mask[c];
+  s->through[n] = through;
+  s->exits[n] = s->exits[p];
+
+  /* the whole of S completes the pattern from position m-1-len */
+  if (len < s->m && (through & s->top))
+  {
+    s->exits[n] |= (uint64_t)1 << (s->m - 1 - len);
+  }
+
+  s->lastHit[n] = (s->inner[n] & s->top) ? n : s->lastHit[p];
+  s->prefix[n] = (int16_t)p;
+  s->length[n] = (uint16_t)len;
+  s->first[n] = s->first[p];
+}
+
+/*--------------------------------------------------------------------*/
+/* Reports the hits ending inside the string of code and steps the matcher
+   over it. Returns 0 if the code is invalid. */
+static int SearchCode (struct searchState *s, int code)
+{
+  unsigned long pos = s->offset;
+  uint64_t hits;
+  int len, j, n = 0, e;
+
+  if (code >= s->RunCode && (code > s->RunCode || s->OldCode == NO_CODE))
+    return 0;
+
+  if (s->OldCode != NO_CODE && s->RunCode < HT_CLEAR_CODE)
+  {
+    AddString (s, s->OldCode, (code == s->RunCode) ? s->first[s->OldCode] : s->first[code]);
+  }
+
+  len = s->length[code];
+
+  /* no version 0 string crosses a phrase block */
+  if (s->phraseBlock && pos % s->phraseBlock + len > s->phraseBlock)
+    return 0;
+
+  /* matches started before S; the earliest start has the highest bit */
+  if ((hits = s->state & s->exits[code]) != 0)
+  {
+    for (j = s->m - 2; j >= 0; j--)
+    {
+      if ((hits >> j) & 1)
+      {
+        s->count++;
+        if (s->hit) s->hit (pos - 1 - j, s->user);
+      }
+    }
+  }
+
+  /* matches inside S, found latest first along the prefix chain */
+  for (e = s->lastHit[code]; e != NO_CODE; e = (s->prefix[e] == NO_CODE) ? NO_CODE : s->lastHit[s->prefix[e]])
+  {
+    s->inside[n++] = pos + s->length[e] - s->m;
+  }
+
+  s->count += n;
+
+  while (n > 0 && s->hit)
+  {
+    s->hit (s->inside[--n], s->user);
+  }
+
+  if (len >= s->m)
+    s->state = s->inner[code];
+  else
+    s->state = ((s->state << len) & s->through[code]) | s->inner[code];
+
+  s->offset += len;
+  s->OldCode = (int16_t)code;
+
+  if (s->phraseBlock && s->offset % s->phraseBlock == 0)
+    s->OldCode = NO_CODE;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int SearchCodes (struct searchState *s, const uint8_t *packed, size_t len)
+{
+  size_t count = s->kernels->unpack_codes (packed, len, s->codes), k;
+
+  for (k = 0; k < count; k++)
+  {
+    if (s->codes[k] == EOF_CODE)
+      return SEARCH_EOF;
+
+    if (s->codes[k] == HT_CLEAR_CODE)
+      ResetDictionary (s);
+    else if (!SearchCode (s, s->codes[k]))
+      return SEARCH_CORRUPT;
+  }
+
+  return SEARCH_MORE;
+}
+
+/*--------------------------------------------------------------------*/
+/* Next len (at most SEARCH_CHUNK) bytes of the image; fewer at its end. */
+static size_t ReadSource (struct searchSource *src, size_t len, const uint8_t **out)
+{
+  if (src->fp)
+  {
+    *out = src->buffer;
+    return fread (src->buffer, 1, len, src->fp);
+  }
+
+  if (len > src->size - src->pos)
+    len = src->size - src->pos;
+
+  *out = src->data + src->pos;
+  src->pos += len;
+
+  return len;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int SearchStream (struct searchState *s, struct searchSource *src)
+{
+  const uint8_t *packed;
+  size_t len;
+  int r;
+
+  while ((len = ReadSource (src, SEARCH_CHUNK, &packed)) > 0)
+  {
+    if ((r = SearchCodes (s, packed, len)) != SEARCH_MORE)
+      return r;
+  }
+
+  return SEARCH_CORRUPT; /* no EOF_CODE */
+}
+
+/*--------------------------------------------------------------------*/
+/* FRAMED_VERSION: each frame starts a new dictionary, the matcher state
+   carries over since the text is continuous. */
+static int SearchFrames (struct searchState *s, struct searchSource *src)
+{
+  const uint8_t *p;
+  uint32_t rawSize, packedSize;
+  unsigned long start;
+  size_t len, want;
+  int r;
+
+  while ((len = ReadSource (src, FRAME_HEADER_SIZE, &p)) > 0)
+  {
+    if (len != FRAME_HEADER_SIZE)
+      return SEARCH_CORRUPT;
+
+    rawSize = get_u32 (p);
+    packedSize = get_u32 (p + 4);
+
+    if (packedSize > FRAME_BOUND(rawSize))
+      return SEARCH_CORRUPT;
+
+    ResetDictionary (s);
+    start = s->offset;
+    r = SEARCH_MORE;
+
+    while (packedSize > 0)
+    {
+      want = (packedSize < SEARCH_CHUNK) ? packedSize : SEARCH_CHUNK;
+
+      if (want != ReadSource (src, want, &p))
+        return SEARCH_CORRUPT;
+
+      packedSize -= want;
+
+      if (r == SEARCH_MORE && (r = SearchCodes (s, p, want)) == SEARCH_CORRUPT)
+        return SEARCH_CORRUPT;
+    }
+
+    if (r != SEARCH_EOF || s->offset - start != rawSize)
+      return SEARCH_CORRUPT;
+  }
+
+  return SEARCH_EOF;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Search (struct searchSource *src, const struct lzwHeader *hdr,
+                   const void *pattern, size_t len, lzwHitFn hit, void *user, unsigned long *count)
+{
+  struct searchState *s;
+  int r;
+
+  if (len < 1 || len > LZW_MAX_PATTERN)
+    return 0;
+
+  /* a reference frame would need the data it points to */
+  if (hdr->version == DEDUP_VERSION)
+    return 0;
+
+  if (NULL == (s = (struct searchState *)malloc(sizeof(struct searchState))))
+    return 0;
+
+  InitSearch (s, (const uint8_t *)pattern, (int)len);
+
+  s->hit = hit;
+  s->user = user;
+  s->phraseBlock = (hdr->version == PACKER_VERSION) ? BUFFLEN : 0;
+
+  if (hdr->version == FRAMED_VERSION)
+    r = SearchFrames (s, src);
+  else
+    r = SearchStream (s, src);
+
+  if (r == SEARCH_EOF && s->offset == hdr->inputSize)
+  {
+    *count = s->count;
+    free (s);
+    return 1;
+  }
+
+  free (s);
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int SearchBuffer (const void *in, size_t size, const void *pattern, size_t len,
+                  lzwHitFn hit, void *user, unsigned long *count)
+{
+  struct lzwHeader hdr;
+  struct searchSource src;
+
+  if (size < HEADER_SIZE || !ParseHeader ((const uint8_t *)in, size, &hdr))
+    return 0;
+
+  src.fp = NULL;
+  src.data = (const uint8_t *)in;
+  src.size = size;
+  src.pos = HEADER_SIZE;
+  src.buffer = NULL;
+
+  return Search (&src, &hdr, pattern, len, hit, user, count);
+}
+
+/*--------------------------------------------------------------------*/
+
+int SearchFile (const char *filename, const void *pattern, size_t len,
+                lzwHitFn hit, void *user, unsigned long *count)
+{
+  FILE *fp;
+  struct lzwHeader hdr;
+  struct searchSource src;
+  int ok;
+
+  if (len < 1 || len > LZW_MAX_PATTERN)
+  {
+    fprintf (stderr, "Pattern must be 1 to %d bytes long.\n", LZW_MAX_PATTERN);
+    return 0;
+  }
+
+  fp = fopen(filename, "rb");
+
+  if (NULL == fp)
+  {
+    fprintf (stderr, "Cannot open file \'%s\'.\n", filename);
+    perror (NULL);
+    return 0;
+  }
+
+  if (!ReadHeader (fp, &hdr))
+  {
+    fclose (fp);
+    return 0;
+  }
+
+  if (hdr.version == DEDUP_VERSION)
+  {
+    fprintf (stderr, "Search does not read deduplicated (-d) files.\n");
+    fclose (fp);
+    return 0;
+  }
+
+  src.fp = fp;
+  src.buffer = (uint8_t *)malloc(SEARCH_CHUNK);
+
+  if (!src.buffer)
+  {
+    perror (NULL);
+    fclose (fp);
+    return 0;
+  }
+
+  if (!(ok = Search (&src, &hdr, pattern, len, hit, user, count)))
+  {
+    fprintf (stderr, "Corrupt input.\n");
+  }
+
+  free (src.buffer);
+  fclose (fp);
+
+  return ok;
+}
@@ -0,0 +1,759 @@
+/* Compression server. One thread runs an epoll loop over the listening
+   socket and all connections; a fixed pool of workers, each holding its
+   own lzwContext, does the compression. Completed requests come back to
+   the loop through an eventfd. SIGINT and SIGTERM are blocked in every
+   thread and read by the loop from a signalfd.
+
+   Backpressure: a connection has at most one request in flight and is
+   not read while it waits, requests beyond the job queue capacity wait
+   unread on their connection, and no new connections are accepted
+   above MAX_CONNECTIONS. */
+
+#define _GNU_SOURCE
+
+#include "server.h"
+#include "lzwclient.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#define MAX_CONNECTIONS   1024
+#define MAX_EVENTS        64
+#define QUEUE_PER_WORKER  4
+
+enum { CONN_READING = 0, CONN_WAITING, CONN_QUEUED, CONN_WRITING, CONN_CLOSED };
+
+struct connection
+{
+  int fd;
+  int state;
+  int closed;           /* peer went away while a worker owned the request */
+
+  uint8_t header[LZW_MSG_HEADER];
+  size_t headerLen;
+  uint32_t len;         /* request payload length */
+  uint8_t *in;          /* request payload */
+  size_t inCap, inLen;
+
+  uint8_t *out;         /* response header and payload */
+  size_t outCap, outLen, outPos;
+
+  struct connection *next;          /* in waiting, jobs, done or closed */
+  struct connection *prevAll, *nextAll;
+};
+
+struct connList
+{
+  struct connection *head, *tail;
+  int count;
+};
+
+struct server
+{
+  int epfd, listenFd, eventFd, signalFd;
+  struct connection *all;
+  int connections, listening;
+  int flags;
+
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  struct connList jobs;     /* guarded by lock */
+  struct connList done;     /* guarded by lock */
+  int queueLimit;
+  int inFlight;             /* owned by the loop: jobs queued or running */
+  int stopping;
+
+  struct connList waiting;  /* owned by the loop: complete requests not yet queued */
+  struct connList closed;   /* owned by the loop: freed after each epoll batch */
+
+  unsigned long requests, bytesIn, bytesOut;
+};
+
+static char listenMarker, eventMarker, signalMarker;
+
+/*--------------------------------------------------------------------*/
+
+static void ListPush (struct connList *list, struct connection *c)
+{
+  c->next = NULL;
+
+  if (list->tail)
+    list->tail->next = c;
+  else
+    list->head = c;
+
+  list->tail = c;
+  list->count++;
+}
+
+static struct connection *ListPop (struct connList *list)
+{
+  struct connection *c = list->head;
+
+  if (c)
+  {
+    list->head = c->next;
+
+    if (list->head == NULL)
+      list->tail = NULL;
+
+    list->count--;
+  }
+
+  return c;
+}
+
+static void ListRemove (struct connList *list, struct connection *c)
+{
+  struct connection **p = &list->head, *prev = NULL;
+
+  while (*p && *p != c)
+  {
+    prev = *p;
+    p = &(*p)->next;
+  }
+
+  if (*p == NULL)
+    return;
+
+  *p = c->next;
+
+  if (list->tail == c)
+    list->tail = prev;
+
+  list->count--;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Reserve (uint8_t **buffer, size_t *cap, size_t size)
+{
+  uint8_t *p;
+
+  if (size <= *cap)
+    return 1;
+
+  p = (uint8_t *)realloc(*buffer, size);
+
+  if (p == NULL)
+    return 0;
+
+  *buffer = p;
+  *cap = size;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void SetResponse (struct connection *c, int status, size_t len)
+{
+  c->out[0] = (uint8_t)len;
+  c->out[1] = (uint8_t)(len >> 8);
+  c->out[2] = (uint8_t)(len >> 16);
+  c->out[3] = (uint8_t)(len >> 24);
+  c->out[4] = (uint8_t)status;
+  c->outLen = LZW_MSG_HEADER + len;
+  c->outPos = 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* Runs on a worker thread, which owns c until it is on the done list. */
+static void Process (struct lzwContext *ctx, struct connection *c)
+{
+  size_t need = 0, size = 0;
+  int op = c->header[4], status = LZW_STATUS_OK;
+
+  if (op == LZW_OP_COMPRESS)
+    need = CompressBound (c->len);
+  else if (op != LZW_OP_DECOMPRESS)
+    status = LZW_STATUS_BAD_REQUEST;
+  else if (!DecompressedSize (c->in, c->len, &need))
+    status = LZW_STATUS_CORRUPT;
+  else if (need > LZW_MAX_PAYLOAD)
+    status = LZW_STATUS_TOO_LARGE;
+
+  if (status != LZW_STATUS_OK)
+    need = 0;
+
+  if (!Reserve (&c->out, &c->outCap, LZW_MSG_HEADER + need))
+  {
+    status = LZW_STATUS_NO_MEMORY;
+
+    if (!Reserve (&c->out, &c->outCap, LZW_MSG_HEADER))
+      return; /* outLen stays 0: the loop drops the connection */
+  }
+
+  if (status == LZW_STATUS_OK && op == LZW_OP_COMPRESS)
+  {
+    if (!CompressBuffer (ctx, c->in, c->len, c->out + LZW_MSG_HEADER, need, &size))
+      status = LZW_STATUS_NO_MEMORY;
+  }
+  else if (status == LZW_STATUS_OK)
+  {
+    if (!DecompressBuffer (ctx, c->in, c->len, c->out + LZW_MSG_HEADER, need, &size))
+      status = LZW_STATUS_CORRUPT;
+  }
+
+  SetResponse (c, status, (status == LZW_STATUS_OK) ? size : 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+struct workerArgs
+{
+  struct server *srv;
+  struct lzwContext *ctx;
+};
+
+static void *Worker (void *arg)
+{
+  struct workerArgs *wa = (struct workerArgs *)arg;
+  struct server *srv = wa->srv;
+  struct connection *c;
+  uint64_t one = 1;
+
+  while (true)
+  {
+    pthread_mutex_lock (&srv->lock);
+
+    while (srv->jobs.head == NULL && !srv->stopping)
+      pthread_cond_wait (&srv->ready, &srv->lock);
+
+    c = ListPop (&srv->jobs);
+    pthread_mutex_unlock (&srv->lock);
+
+    if (c == NULL)
+      break;
+
+    Process (wa->ctx, c);
+
+    pthread_mutex_lock (&srv->lock);
+    ListPush (&srv->done, c);
+    pthread_mutex_unlock (&srv->lock);
+
+    if (write (srv->eventFd, &one, sizeof(one)) != sizeof(one))
+      perror ("eventfd");
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Watch (struct server *srv, struct connection *c, uint32_t events)
+{
+  struct epoll_event ev;
+
+  ev.events = events;
+  ev.data.ptr = c;
+  epoll_ctl (srv->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void SetListening (struct server *srv, int on)
+{
+  struct epoll_event ev;
+
+  if (on == srv->listening)
+    return;
+
+  ev.events = on ? EPOLLIN : 0;
+  ev.data.ptr = &listenMarker;
+  epoll_ctl (srv->epfd, EPOLL_CTL_MOD, srv->listenFd, &ev);
+  srv->listening = on;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void CloseConnection (struct server *srv, struct connection *c)
+{
+  epoll_ctl (srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+  close (c->fd);
+
+  if (c->prevAll)
+    c->prevAll->nextAll = c->nextAll;
+  else
+    srv->all = c->nextAll;
+
+  if (c->nextAll)
+    c->nextAll->prevAll = c->prevAll;
+
+  /* later events of the same epoll batch may still point at c */
+  c->state = CONN_CLOSED;
+  ListPush (&srv->closed, c);
+
+  srv->connections--;
+  SetListening (srv, srv->connections < MAX_CONNECTIONS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void FreeClosed (struct server *srv)
+{
+  struct connection *c;
+
+  while ((c = ListPop (&srv->closed)) != NULL)
+  {
+    free (c->in);
+    free (c->out);
+    free (c);
+  }
+}
+
+/*--------------------------------------------------------------------*/
+/* Moves waiting requests to the job queue while it has room. */
+static void Dispatch (struct server *srv)
+{
+  struct connection *c;
+  int queued = 0;
+
+  pthread_mutex_lock (&srv->lock);
+
+  while (srv->inFlight < srv->queueLimit && (c = ListPop (&srv->waiting)) != NULL)
+  {
+    c->state = CONN_QUEUED;
+    ListPush (&srv->jobs, c);
+    srv->inFlight++;
+    queued++;
+  }
+
+  if (queued)
+    pthread_cond_broadcast (&srv->ready);
+
+  pthread_mutex_unlock (&srv->lock);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void FlushResponse (struct server *srv, struct connection *c)
+{
+  ssize_t n;
+
+  while (c->outPos < c->outLen)
+  {
+    n = send (c->fd, c->out + c->outPos, c->outLen - c->outPos, MSG_NOSIGNAL);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      Watch (srv, c, EPOLLOUT);
+      return;
+    }
+
+    if (n <= 0)
+    {
+      CloseConnection (srv, c);
+      return;
+    }
+
+    c->outPos += n;
+  }
+
+  srv->bytesOut += c->outLen - LZW_MSG_HEADER;
+
+  c->state = CONN_READING;
+  c->headerLen = 0;
+  c->inLen = 0;
+  Watch (srv, c, EPOLLIN);
+}
+
+/*--------------------------------------------------------------------*/
+/* Reads until a request is complete or the socket would block. */
+static void ReadRequest (struct server *srv, struct connection *c)
+{
+  ssize_t n;
+
+  while (true)
+  {
+    if (c->headerLen < LZW_MSG_HEADER)
+      n = recv (c->fd, c->header + c->headerLen, LZW_MSG_HEADER - c->headerLen, 0);
+    else if (c->inLen < c->len)
+      n = recv (c->fd, c->in + c->inLen, c->len - c->inLen, 0);
+    else
+      break;
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+
+    if (n <= 0)
+    {
+      CloseConnection (srv, c);
+      return;
+    }
+
+    if (c->headerLen < LZW_MSG_HEADER)
+    {
+      c->headerLen += n;
+
+      if (c->headerLen == LZW_MSG_HEADER)
+      {
+        c->len = c->header[0] | (c->header[1] << 8) | (c->header[2] << 16) | ((uint32_t)c->header[3] << 24);
+
+        if (c->len > LZW_MAX_PAYLOAD || !Reserve (&c->in, &c->inCap, c->len))
+        {
+          CloseConnection (srv, c);
+          return;
+        }
+      }
+    }
+    else
+      c->inLen += n;
+  }
+
+  /* complete: stop reading this connection until the response is out */
+  srv->requests++;
+  srv->bytesIn += c->len;
+
+  c->outLen = 0;
+  c->state = CONN_WAITING;
+  Watch (srv, c, 0);
+  ListPush (&srv->waiting, c);
+  Dispatch (srv);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void AcceptConnections (struct server *srv)
+{
+  struct epoll_event ev;
+  struct connection *c;
+  int fd;
+
+  while (srv->connections < MAX_CONNECTIONS)
+  {
+    fd = accept4 (srv->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (fd < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        perror ("accept");
+      break;
+    }
+
+    c = (struct connection *)calloc(1, sizeof(struct connection));
+
+    if (c == NULL)
+    {
+      close (fd);
+      break;
+    }
+
+    c->fd = fd;
+    c->state = CONN_READING;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+
+    if (epoll_ctl (srv->epfd, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+      close (fd);
+      free (c);
+      continue;
+    }
+
+    c->nextAll = srv->all;
+
+    if (srv->all)
+      srv->all->prevAll = c;
+
+    srv->all = c;
+    srv->connections++;
+  }
+
+  SetListening (srv, srv->connections < MAX_CONNECTIONS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void CollectDone (struct server *srv)
+{
+  struct connList done;
+  struct connection *c;
+  uint64_t count;
+
+  if (read (srv->eventFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    perror ("eventfd");
+
+  pthread_mutex_lock (&srv->lock);
+  done = srv->done;
+  srv->done.head = srv->done.tail = NULL;
+  srv->done.count = 0;
+  srv->inFlight -= done.count;
+  pthread_mutex_unlock (&srv->lock);
+
+  while ((c = ListPop (&done)) != NULL)
+  {
+    if (c->closed || c->outLen == 0)
+    {
+      CloseConnection (srv, c);
+      continue;
+    }
+
+    c->state = CONN_WRITING;
+    FlushResponse (srv, c);
+  }
+
+  Dispatch (srv);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void OnConnectionEvent (struct server *srv, struct connection *c, uint32_t events)
+{
+  if (c->state == CONN_CLOSED)
+    return;
+
+  if (events & (EPOLLHUP | EPOLLERR))
+  {
+    if (c->state == CONN_QUEUED)
+    {
+      /* a worker has it; close once it comes back */
+      c->closed = true;
+      epoll_ctl (srv->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+      return;
+    }
+
+    if (c->state == CONN_WAITING)
+      ListRemove (&srv->waiting, c);
+
+    CloseConnection (srv, c);
+    return;
+  }
+
+  if (c->state == CONN_READING && (events & EPOLLIN))
+    ReadRequest (srv, c);
+  else if (c->state == CONN_WRITING && (events & EPOLLOUT))
+    FlushResponse (srv, c);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int OpenListener (const char *path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd;
+
+  if (strlen (path) >= sizeof(addr.sun_path))
+  {
+    fprintf (stderr, "Socket path too long.\n");
+    return -1;
+  }
+
+  /* remove a stale socket left by a previous run, but nothing else */
+  if (stat (path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink (path);
+
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+  if (fd < 0)
+  {
+    perror ("socket");
+    return -1;
+  }
+
+  memset (&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+
+  if (bind (fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen (fd, SOMAXCONN) != 0)
+  {
+    fprintf (stderr, "Cannot listen on \'%s\'.\n", path);
+    perror (NULL);
+    close (fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/*--------------------------------------------------------------------*/
+/* Takes the pending SIGINT or SIGTERM, so it does not fire once the
+   mask is restored. */
+static int StopSignal (int fd)
+{
+  struct signalfd_siginfo info;
+
+  return read (fd, &info, sizeof(info)) == sizeof(info);
+}
+
+/*--------------------------------------------------------------------*/
+
+int RunServer (const char *path, int workers, int flags)
+{
+  struct server srv;
+  struct epoll_event ev, events[MAX_EVENTS];
+  sigset_t stopSignals, oldMask;
+  struct workerArgs *args = NULL;
+  pthread_t *threads = NULL;
+  int i, n, started = 0, stop = false, ret = EXIT_FAILURE;
+
+  memset (&srv, 0, sizeof(srv));
+  srv.flags = flags;
+  srv.queueLimit = workers * QUEUE_PER_WORKER;
+  srv.epfd = srv.eventFd = srv.signalFd = -1;
+
+  /* blocked before any worker starts, so they inherit the mask and only
+     the signalfd sees the signals */
+  sigemptyset (&stopSignals);
+  sigaddset (&stopSignals, SIGINT);
+  sigaddset (&stopSignals, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, &stopSignals, &oldMask);
+  signal (SIGPIPE, SIG_IGN);
+
+  pthread_mutex_init (&srv.lock, NULL);
+  pthread_cond_init (&srv.ready, NULL);
+
+  if ((srv.listenFd = OpenListener (path)) < 0)
+  {
+    pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+    return EXIT_FAILURE;
+  }
+
+  srv.epfd = epoll_create1 (EPOLL_CLOEXEC);
+  srv.eventFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  srv.signalFd = signalfd (-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  args = (struct workerArgs *)calloc(workers, sizeof(struct workerArgs));
+  threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+
+  if (srv.epfd < 0 || srv.eventFd < 0 || srv.signalFd < 0 || !args || !threads)
+  {
+    perror (NULL);
+    goto done;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = &listenMarker;
+  epoll_ctl (srv.epfd, EPOLL_CTL_ADD, srv.listenFd, &ev);
+  srv.listening = true;
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = &eventMarker;
+  epoll_ctl (srv.epfd, EPOLL_CTL_ADD, srv.eventFd, &ev);
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = &signalMarker;
+  epoll_ctl (srv.epfd, EPOLL_CTL_ADD, srv.signalFd, &ev);
+
+  /* all codec state is allocated here, not per request */
+  for (started = 0; started < workers; started++)
+  {
+    args[started].srv = &srv;
+    args[started].ctx = CreateContext (flags | BLOCKED_OUTPUT);
+
+    if (args[started].ctx == NULL
+        || pthread_create (&threads[started], NULL, Worker, &args[started]) != 0)
+    {
+      fprintf (stderr, "Cannot start worker %d.\n", started);
+      FreeContext (args[started].ctx);
+      goto done;
+    }
+  }
+
+  if (flags & VERBOSE_OUTPUT)
+    printf ("Listening on %s with %d workers.\n", path, workers);
+
+  while (!stop)
+  {
+    n = epoll_wait (srv.epfd, events, MAX_EVENTS, -1);
+
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      perror ("epoll_wait");
+      goto done;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+      if (events[i].data.ptr == &listenMarker)
+        AcceptConnections (&srv);
+      else if (events[i].data.ptr == &eventMarker)
+        CollectDone (&srv);
+      else if (events[i].data.ptr == &signalMarker)
+        stop = StopSignal (srv.signalFd);
+      else
+        OnConnectionEvent (&srv, (struct connection *)events[i].data.ptr, events[i].events);
+    }
+
+    FreeClosed (&srv);
+  }
+
+  ret = EXIT_SUCCESS;
+
+done:
+  pthread_mutex_lock (&srv.lock);
+  srv.stopping = true;
+  pthread_cond_broadcast (&srv.ready);
+  pthread_mutex_unlock (&srv.lock);
+
+  /* workers drain the job queue before they exit */
+  for (i = 0; i < started; i++)
+  {
+    pthread_join (threads[i], NULL);
+    FreeContext (args[i].ctx);
+  }
+
+  /* no worker holds a connection any more */
+  while (srv.all != NULL)
+    CloseConnection (&srv, srv.all);
+
+  FreeClosed (&srv);
+
+  if (flags & VERBOSE_OUTPUT)
+    printf ("Served %lu requests, %lu bytes in, %lu bytes out.\n",
+            srv.requests, srv.bytesIn, srv.bytesOut);
+
+  close (srv.listenFd);
+  unlink (path);
+
+  if (srv.eventFd >= 0) close (srv.eventFd);
+  if (srv.signalFd >= 0) close (srv.signalFd);
+  if (srv.epfd >= 0) close (srv.epfd);
+  pthread_sigmask (SIG_SETMASK, &oldMask, NULL);
+
+  pthread_mutex_destroy (&srv.lock);
+  pthread_cond_destroy (&srv.ready);
+
+  free (args);
+  free (threads);
+
+  return ret;
+}
+
+#else
+
+int RunServer (const char *path, int workers, int flags)
+{
+  (void)path; (void)workers; (void)flags;
+  fprintf (stderr, "Server mode is supported on Linux only.\n");
+  return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,6 @@
+#pragma once
+
+/* lzw06 --serve: compression daemon on a Unix domain socket (Linux only).
+   Protocol in lzwclient.h. Returns EXIT_SUCCESS after SIGINT/SIGTERM. */
+
+int RunServer (const char *path, int workers, int flags);
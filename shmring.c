@@ -0,0 +1,514 @@
+/* Shared memory record ring and the --shm-in compressor. See shmring.h. */
+
+#define _GNU_SOURCE
+
+#include "shmring.h"
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CACHE_LINE        64
+#define RING_MAGIC        0x524E474CUL   /* "LGNR" */
+#define RING_VERSION      1
+#define RING_HEADER_SIZE  (4 * CACHE_LINE)
+#define RING_MIN_SIZE     4096
+#define RING_MAX_SIZE     (1UL << 31)
+#define DEFAULT_RING_SIZE (64UL << 20)
+
+#define WRAP_MARK         0xFFFFFFFFUL   /* rest of the ring is unused, go to 0 */
+#define RECORD_HEADER     8
+#define RECORD_SIZE(len)  (RECORD_HEADER + (((uint64_t)(len) + 7) & ~(uint64_t)7))
+
+/* head and tail sit on their own cache lines so the two sides do not
+   invalidate each other's line on every update */
+struct ringHeader
+{
+  uint32_t magic;        /* written last by the creator */
+  uint32_t version;
+  uint64_t capacity;
+  uint8_t pad0[CACHE_LINE - 16];
+
+  uint64_t head;         /* producer */
+  uint8_t pad1[CACHE_LINE - 8];
+
+  uint64_t tail;         /* consumer */
+  uint8_t pad2[CACHE_LINE - 8];
+
+  uint32_t closed;       /* producer: no more records */
+};
+
+struct shmRing
+{
+  struct ringHeader *hdr;
+  uint8_t *data;
+  size_t mapSize;
+  uint64_t capacity;
+
+  uint64_t head, tail;   /* private copies of the index this side owns */
+  uint64_t skip;         /* producer: bytes left unused before the reserved record */
+  uint64_t current;      /* consumer: length of the peeked record */
+};
+
+/*--------------------------------------------------------------------*/
+
+static int MapRing (struct shmRing *ring, int fd, size_t size)
+{
+  void *p = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+  if (p == MAP_FAILED)
+    return 0;
+
+  ring->hdr = (struct ringHeader *)p;
+  ring->data = (uint8_t *)p + RING_HEADER_SIZE;
+  ring->mapSize = size;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* Waits for the creator to size and initialize the object. */
+static int AttachRing (struct shmRing *ring, int fd)
+{
+  struct stat st;
+  int spins = 0, tries;
+
+  for (tries = 0; tries < 10000; tries++)
+  {
+    if (fstat (fd, &st) != 0)
+      return 0;
+
+    if ((size_t)st.st_size > RING_HEADER_SIZE)
+      break;
+
+    RingBackoff (&spins);
+  }
+
+  if (!MapRing (ring, fd, st.st_size))
+    return 0;
+
+  for (; tries < 10000; tries++)
+  {
+    if (__atomic_load_n (&ring->hdr->magic, __ATOMIC_ACQUIRE) == RING_MAGIC)
+      break;
+
+    RingBackoff (&spins);
+  }
+
+  if (ring->hdr->magic != RING_MAGIC || ring->hdr->version != RING_VERSION
+      || RING_HEADER_SIZE + ring->hdr->capacity != (uint64_t)st.st_size)
+  {
+    fprintf (stderr, "Not an lzw06 ring.\n");
+    return 0;
+  }
+
+  ring->capacity = ring->hdr->capacity;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+struct shmRing *RingOpen (const char *name, size_t capacity)
+{
+  struct shmRing *ring;
+  uint64_t size = RING_MIN_SIZE;
+  int fd, ok;
+
+  ring = (struct shmRing *)calloc(1, sizeof(struct shmRing));
+
+  if (ring == NULL)
+    return NULL;
+
+  while (size < capacity && size < RING_MAX_SIZE)
+    size <<= 1;
+
+  fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd >= 0)
+  {
+    ok = ftruncate (fd, RING_HEADER_SIZE + size) == 0 && MapRing (ring, fd, RING_HEADER_SIZE + size);
+
+    if (ok)
+    {
+      ring->hdr->version = RING_VERSION;
+      ring->hdr->capacity = size;
+      ring->capacity = size;
+      __atomic_store_n (&ring->hdr->magic, RING_MAGIC, __ATOMIC_RELEASE);
+    }
+    else
+      shm_unlink (name);
+  }
+  else if (errno == EEXIST && (fd = shm_open (name, O_RDWR, 0600)) >= 0)
+  {
+    ok = AttachRing (ring, fd);
+
+    /* left finished by an earlier run: start over empty */
+    if (ok && __atomic_load_n (&ring->hdr->closed, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE) == __atomic_load_n (&ring->hdr->tail, __ATOMIC_ACQUIRE))
+      __atomic_store_n (&ring->hdr->closed, 0, __ATOMIC_RELEASE);
+  }
+  else
+    ok = false;
+
+  if (fd >= 0)
+    close (fd);
+
+  if (!ok)
+  {
+    fprintf (stderr, "Cannot open shared memory ring \'%s\'.\n", name);
+    perror (NULL);
+    RingDetach (ring);
+    return NULL;
+  }
+
+  ring->head = __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE);
+  ring->tail = __atomic_load_n (&ring->hdr->tail, __ATOMIC_ACQUIRE);
+
+  return ring;
+}
+
+/*--------------------------------------------------------------------*/
+
+void RingDetach (struct shmRing *ring)
+{
+  if (ring == NULL)
+    return;
+
+  if (ring->hdr)
+    munmap (ring->hdr, ring->mapSize);
+
+  free (ring);
+}
+
+/*--------------------------------------------------------------------*/
+
+int RingUnlink (const char *name)
+{
+  return shm_unlink (name) == 0 ? 1 : 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t RingMaxRecord (const struct shmRing *ring)
+{
+  return ring->capacity / 2 - RECORD_HEADER;
+}
+
+/*--------------------------------------------------------------------*/
+
+void *RingReserve (struct shmRing *ring, size_t len)
+{
+  uint64_t pos = ring->head & (ring->capacity - 1), need = RECORD_SIZE(len), skip = 0, tail;
+
+  if (len > RingMaxRecord (ring))
+    return NULL;
+
+  /* records are contiguous; leave the end of the ring unused if needed */
+  if (pos + need > ring->capacity)
+    skip = ring->capacity - pos;
+
+  tail = __atomic_load_n (&ring->hdr->tail, __ATOMIC_ACQUIRE);
+
+  if (ring->head + skip + need - tail > ring->capacity)
+    return NULL;
+
+  ring->skip = skip;
+
+  return ring->data + ((ring->head + skip) & (ring->capacity - 1)) + RECORD_HEADER;
+}
+
+/*--------------------------------------------------------------------*/
+/* len may be less than what was reserved */
+void RingCommit (struct shmRing *ring, size_t len)
+{
+  uint64_t mask = ring->capacity - 1;
+
+  if (ring->skip)
+    *(uint32_t *)(ring->data + (ring->head & mask)) = (uint32_t)WRAP_MARK;
+
+  ring->head += ring->skip;
+  *(uint32_t *)(ring->data + (ring->head & mask)) = (uint32_t)len;
+  ring->head += RECORD_SIZE(len);
+  ring->skip = 0;
+
+  __atomic_store_n (&ring->hdr->head, ring->head, __ATOMIC_RELEASE);
+}
+
+/*--------------------------------------------------------------------*/
+
+void RingClose (struct shmRing *ring)
+{
+  __atomic_store_n (&ring->hdr->closed, 1, __ATOMIC_RELEASE);
+}
+
+/*--------------------------------------------------------------------*/
+
+const void *RingPeek (struct shmRing *ring, size_t *len)
+{
+  uint64_t head = __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE), pos;
+  uint32_t size;
+
+  while (ring->tail != head)
+  {
+    pos = ring->tail & (ring->capacity - 1);
+    size = *(const uint32_t *)(ring->data + pos);
+
+    if (size == WRAP_MARK)
+    {
+      ring->tail += ring->capacity - pos;
+      continue;
+    }
+
+    ring->current = size;
+    *len = size;
+
+    return ring->data + pos + RECORD_HEADER;
+  }
+
+  return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+void RingRelease (struct shmRing *ring)
+{
+  ring->tail += RECORD_SIZE(ring->current);
+
+  __atomic_store_n (&ring->hdr->tail, ring->tail, __ATOMIC_RELEASE);
+}
+
+/*--------------------------------------------------------------------*/
+
+int RingFinished (struct shmRing *ring)
+{
+  /* closed is set after the last commit, so head is final once it is seen */
+  if (!__atomic_load_n (&ring->hdr->closed, __ATOMIC_ACQUIRE))
+    return 0;
+
+  return __atomic_load_n (&ring->hdr->head, __ATOMIC_ACQUIRE) == ring->tail ? 1 : 0;
+}
+
+/*--------------------------------------------------------------------*/
+/* spin briefly, then yield, then sleep up to a millisecond */
+void RingBackoff (int *spins)
+{
+  struct timespec ts;
+
+  if (++*spins < 64)
+    return;
+
+  if (*spins < 128)
+  {
+    sched_yield ();
+    return;
+  }
+
+  ts.tv_sec = 0;
+  ts.tv_nsec = (*spins < 1128) ? (*spins - 127) * 1000L : 1000000L;
+  nanosleep (&ts, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+/* Waits for room in the output ring; NULL if the job was cancelled. */
+static void *ReserveOutput (struct shmRing *out, size_t len, struct progressState *ps)
+{
+  void *p;
+  int spins = 0;
+
+  while ((p = RingReserve (out, len)) == NULL)
+  {
+    if (!UpdateProgress (ps, ps->bytesIn, ps->bytesOut))
+      return NULL;
+
+    RingBackoff (&spins);
+  }
+
+  return p;
+}
+
+/*--------------------------------------------------------------------*/
+
+int CompressRing (const char *inRing, const char *outRing, const char *outfile,
+                  const struct lzwOptions *options)
+{
+  struct shmRing *in = NULL, *out = NULL;
+  struct lzwContext *ctx = NULL;
+  struct progressState ps;
+  FILE *fout = NULL;
+  uint8_t *scratch = NULL, *dst;
+  const void *record;
+  size_t len, bound, size;
+  unsigned long bytesIn = 0, bytesOut = 0;
+  int spins = 0, flags = options->flags, compress_ok = false;
+
+  InitProgress (&ps, options, 0, false);
+
+  in = RingOpen (inRing, DEFAULT_RING_SIZE);
+  ctx = CreateContext (flags | BLOCKED_OUTPUT);
+
+  if (in == NULL || ctx == NULL)
+    goto done;
+
+  bound = CompressBound (RingMaxRecord (in));
+
+  if (outRing)
+  {
+    if ((out = RingOpen (outRing, 2 * (bound + RECORD_HEADER))) == NULL)
+      goto done;
+
+    if (RingMaxRecord (out) < bound)
+    {
+      fprintf (stderr, "Output ring \'%s\' is too small for the input ring.\n", outRing);
+      goto done;
+    }
+  }
+  else
+  {
+    scratch = (uint8_t *)malloc(bound);
+    fout = fopen (outfile, "wb");
+
+    if (fout == NULL || scratch == NULL)
+    {
+      fprintf (stderr, "Cannot open output file \'%s\'.\n", outfile);
+      perror (NULL);
+      goto done;
+    }
+
+    /* the size goes in once the producer is done */
+    bytesOut = HEADER_SIZE;
+    WriteHeader (fout, FRAMED_VERSION, 0);
+  }
+
+  while (true)
+  {
+    if ((record = RingPeek (in, &len)) == NULL)
+    {
+      if (RingFinished (in))
+        break;
+
+      if (!UpdateProgress (&ps, bytesIn, bytesOut))
+        goto done;
+
+      RingBackoff (&spins);
+      continue;
+    }
+
+    spins = 0;
+
+    /* compressed straight from one shared mapping into the other */
+    if (out)
+    {
+      if ((dst = (uint8_t *)ReserveOutput (out, CompressBound (len), &ps)) == NULL)
+        goto done;
+
+      if (!CompressBuffer (ctx, record, len, dst, CompressBound (len), &size))
+      {
+        fprintf (stderr, "Cannot compress a record.\n");
+        goto done;
+      }
+
+      RingCommit (out, size);
+    }
+    else
+    {
+      if (bytesIn + len > 0xFFFFFFFFUL)
+      {
+        fprintf (stderr, "Input is larger than 4 GB.\n");
+        goto done;
+      }
+
+      if (!CompressFrames (ctx, record, len, scratch, bound, &size))
+      {
+        fprintf (stderr, "Cannot compress a record.\n");
+        goto done;
+      }
+
+      if (size != fwrite (scratch, 1, size, fout))
+      {
+        fprintf (stderr, "Write error. Out of disk space? \n");
+        goto done;
+      }
+    }
+
+    RingRelease (in);
+
+    bytesIn += len;
+    bytesOut += size;
+
+    if (!UpdateProgress (&ps, bytesIn, bytesOut))
+      goto done;
+  }
+
+  compress_ok = true;
+
+  if (fout)
+  {
+    fseek (fout, 0, SEEK_SET);
+    compress_ok = WriteHeader (fout, FRAMED_VERSION, (uint32_t)bytesIn);
+  }
+
+  FinishProgress (&ps);
+
+done:
+  if (out)
+    RingClose (out);
+
+  if (fout && EOF == fclose (fout))
+  {
+    fprintf (stderr, "Write error. Out of disk space? \n");
+    compress_ok = false;
+  }
+
+  if (fout && !compress_ok)
+    cleanup (outfile, flags);
+
+  RingDetach (in);
+  RingDetach (out);
+  FreeContext (ctx);
+  free (scratch);
+
+  return compress_ok;
+}
+
+#else
+
+struct shmRing *RingOpen (const char *name, size_t capacity)
+{
+  (void)name; (void)capacity;
+  fprintf (stderr, "Shared memory rings are supported on Linux only.\n");
+  return NULL;
+}
+
+void RingDetach (struct shmRing *ring) { (void)ring; }
+int RingUnlink (const char *name) { (void)name; return 0; }
+size_t RingMaxRecord (const struct shmRing *ring) { (void)ring; return 0; }
+void *RingReserve (struct shmRing *ring, size_t len) { (void)ring; (void)len; return NULL; }
+void RingCommit (struct shmRing *ring, size_t len) { (void)ring; (void)len; }
+void RingClose (struct shmRing *ring) { (void)ring; }
+const void *RingPeek (struct shmRing *ring, size_t *len) { (void)ring; (void)len; return NULL; }
+void RingRelease (struct shmRing *ring) { (void)ring; }
+int RingFinished (struct shmRing *ring) { (void)ring; return 1; }
+void RingBackoff (int *spins) { (void)spins; }
+
+int CompressRing (const char *inRing, const char *outRing, const char *outfile,
+                  const struct lzwOptions *options)
+{
+  (void)inRing; (void)outRing; (void)outfile; (void)options;
+  fprintf (stderr, "Shared memory rings are supported on Linux only.\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+/* Single producer, single consumer ring of variable length records in
+   POSIX shared memory (Linux only). head and tail are only ever advanced
+   by their owner, so neither side takes a lock; a reader works on the
+   record in place, a writer builds it in place.
+
+   Producer: RingReserve, fill the returned space, RingCommit; RingClose
+   after the last record. Consumer: RingPeek, use the record, RingRelease;
+   RingFinished once the producer closed and everything was read.
+   Reserve and Peek return NULL when they would have to wait; RingBackoff
+   is a polite way to do so. */
+
+#include <stddef.h>
+
+#include "export.h"
+
+struct shmRing;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Creates the ring with capacity bytes of data (rounded up to a power of
+   two), or attaches to it if it already exists. A ring an earlier run
+   left closed and fully read is reopened empty. Returns NULL on error. */
+extern struct shmRing *RingOpen (const char *name, size_t capacity);
+extern void RingDetach (struct shmRing *ring);
+extern int RingUnlink (const char *name);
+
+/* largest record the ring accepts: half its capacity minus framing */
+extern size_t RingMaxRecord (const struct shmRing *ring);
+
+extern void *RingReserve (struct shmRing *ring, size_t len);
+extern void RingCommit (struct shmRing *ring, size_t len);
+extern void RingClose (struct shmRing *ring);
+
+extern const void *RingPeek (struct shmRing *ring, size_t *len);
+extern void RingRelease (struct shmRing *ring);
+extern int RingFinished (struct shmRing *ring);
+
+extern void RingBackoff (int *spins);
+
+/* lzw06 --shm-in: compresses every record of the input ring. With an
+   output ring each record becomes one record holding a complete framed
+   image (see CompressBuffer); otherwise all records go to outfile as one
+   framed (-b) file. Closes the output ring when the input is finished.
+   Returns 1 on success, 0 on error. */
+extern int CompressRing (const char *inRing, const char *outRing, const char *outfile,
+                         const struct lzwOptions *options);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,396 @@
+/* Incremental compression for many concurrent streams. See export.h.
+   A stream allocates its tables on the first data it sees. Hibernating
+   it keeps only its dictionary strings, 20 bits each, and frees the
+   tables; they are rebuilt in the same order on the next call, so the
+   output does not change. */
+
+#include "codec.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define STREAM_CHUNK   4096   /* input bytes per encode_block call */
+#define NO_KEY         HT_EMPTY_KEY   /* FAST_MODE: code no longer in the table */
+
+struct lzwStream
+{
+  const struct lzwKernels *kernels;
+  int flags;
+  int decode;
+
+  /* encoder */
+  struct encodeState es;    /* es.table NULL while asleep */
+  int held;                 /* odd code waiting for its pair, or NO_PHRASE */
+
+  /* decoder */
+  struct unpackHelper *uh;  /* NULL while asleep */
+  int RunCode, OldCode;     /* of uh while asleep */
+  int asleep;               /* uh state saved by HibernateStream */
+  int phase;                /* bytes of the current code pair read */
+  uint16_t bits;            /* of a code not yet complete */
+  int pending;              /* code that did not fit the output, or NO_PHRASE */
+  int ended;                /* EOF_CODE read */
+
+  /* asleep */
+  uint8_t *image;           /* strings of codes 256 and up */
+  size_t imageSize;
+};
+
+/*--------------------------------------------------------------------*/
+/* Strings are packed two to 5 bytes. */
+
+static size_t ImageSize (int strings)
+{
+  return (5 * (size_t)strings + 1) / 2;
+}
+
+static void PutKey (uint8_t *image, int i, uint32_t key)
+{
+  uint8_t *p = image + (size_t)(i / 2) * 5;
+
+  if (i % 2 == 0)
+  {
+    p[0] = (uint8_t)key;
+    p[1] = (uint8_t)(key >> 8);
+    p[2] = (uint8_t)((p[2] & 0xF0) | (key >> 16));
+  }
+  else
+  {
+    p[2] = (uint8_t)((p[2] & 0x0F) | ((key & 0x0F) << 4));
+    p[3] = (uint8_t)(key >> 4);
+    p[4] = (uint8_t)(key >> 12);
+  }
+}
+
+static uint32_t GetKey (const uint8_t *image, int i)
+{
+  const uint8_t *p = image + (size_t)(i / 2) * 5;
+
+  if (i % 2 == 0)
+    return p[0] | (p[1] << 8) | ((uint32_t)(p[2] & 0x0F) << 16);
+
+  return (p[2] >> 4) | (p[3] << 4) | ((uint32_t)p[4] << 12);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct lzwStream *NewStream (int flags, int decode)
+{
+  struct lzwStream *s = (struct lzwStream *)calloc(1, sizeof(struct lzwStream));
+
+  if (s == NULL)
+    return NULL;
+
+  s->kernels = GetKernels ();
+  s->flags = flags;
+  s->decode = decode;
+  s->es.tableSize = (flags & FAST_MODE) ? FAST_HT_SIZE : HT_SIZE;
+  s->es.RunCode = 256;
+  s->es.CurCode = NO_PHRASE;
+  s->held = s->pending = NO_PHRASE;
+
+  return s;
+}
+
+struct lzwStream *CreateEncoderStream (int flags)
+{
+  return NewStream (flags & FAST_MODE, 0);
+}
+
+struct lzwStream *CreateDecoderStream (void)
+{
+  return NewStream (0, 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+void FreeStream (struct lzwStream *s)
+{
+  if (s == NULL)
+    return;
+
+  FreeEncodeState (&s->es);
+  free (s->uh);
+  free (s->image);
+  free (s);
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t StreamMemory (const struct lzwStream *s)
+{
+  size_t size = sizeof(struct lzwStream) + s->imageSize;
+
+  if (s->es.table)
+    size += s->es.tableSize * sizeof(uint32_t);
+
+  if (s->uh)
+    size += sizeof(struct unpackHelper);
+
+  return size;
+}
+
+/*--------------------------------------------------------------------*/
+
+int HibernateStream (struct lzwStream *s)
+{
+  int strings, i;
+  uint32_t entry;
+
+  if (s->decode ? s->uh == NULL : s->es.table == NULL)
+    return 1;
+
+  strings = (s->decode ? s->uh->RunCode : s->es.RunCode) - 256;
+
+  if (strings > 0 && NULL == (s->image = (uint8_t *)malloc(ImageSize (strings))))
+    return 0;
+
+  s->imageSize = (strings > 0) ? ImageSize (strings) : 0;
+
+  if (s->decode)
+  {
+    for (i = 0; i < strings; i++)
+      PutKey (s->image, i, ((uint32_t)s->uh->prefix[256 + i] << 8) | s->uh->suffix[256 + i]);
+
+    s->RunCode = s->uh->RunCode;
+    s->OldCode = s->uh->OldCode;
+    s->asleep = 1;
+    free (s->uh);
+    s->uh = NULL;
+  }
+  else
+  {
+    /* a FAST_MODE table may have lost some codes to collisions */
+    if (strings > 0)
+      memset (s->image, 0xFF, s->imageSize);
+
+    for (i = 0; i < (int)s->es.tableSize; i++)
+    {
+      entry = s->es.table[i];
+
+      if (HT_GET_KEY(entry) != HT_EMPTY_KEY)
+        PutKey (s->image, (int)HT_GET_CODE(entry) - 256, HT_GET_KEY(entry));
+    }
+
+    FreeEncodeState (&s->es);
+  }
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* Allocates the tables and fills them from the image, if any. */
+static int Wake (struct lzwStream *s)
+{
+  int RunCode, CurCode, i;
+  insertKeyFn insert;
+  uint32_t key;
+
+  if (s->decode ? s->uh != NULL : s->es.table != NULL)
+    return 1;
+
+  if (s->decode)
+  {
+    if (NULL == (s->uh = (struct unpackHelper *)malloc(sizeof(struct unpackHelper))))
+      return 0;
+
+    ResetUnpackHelper (s->uh);
+
+    if (s->asleep)
+    {
+      for (i = 0; i < s->RunCode - 256; i++)
+      {
+        key = GetKey (s->image, i);
+        s->uh->prefix[256 + i] = (uint16_t)(key >> 8);
+        s->uh->suffix[256 + i] = (uint16_t)(key & 0xFF);
+      }
+
+      s->uh->RunCode = (int16_t)s->RunCode;
+      s->uh->OldCode = (int16_t)s->OldCode;
+      s->asleep = 0;
+    }
+  }
+  else
+  {
+    RunCode = s->es.RunCode;
+    CurCode = s->es.CurCode;
+
+    if (!InitEncodeState (&s->es, s->flags))
+      return 0;
+
+    insert = (s->flags & FAST_MODE) ? s->kernels->insert_key_fast : s->kernels->insert_key;
+
+    /* in code order, as the encoder added them */
+    for (i = 0; i < RunCode - 256; i++)
+      if ((key = GetKey (s->image, i)) != NO_KEY)
+        insert (s->es.table, key, 256 + i);
+
+    s->es.RunCode = RunCode;
+    s->es.CurCode = CurCode;
+  }
+
+  free (s->image);
+  s->image = NULL;
+  s->imageSize = 0;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t StreamBound (size_t size)
+{
+  return PACKED_SIZE(MAX_CODES(size) + 3);   /* a held code, the open phrase and EOF_CODE */
+}
+
+/*--------------------------------------------------------------------*/
+
+int StreamCompress (struct lzwStream *s, const void *in, size_t size,
+                    void *out, size_t capacity, size_t *outSize)
+{
+  const uint8_t *src = (const uint8_t *)in;
+  uint8_t *dst = (uint8_t *)out;
+  uint16_t codes[MAX_CODES(STREAM_CHUNK) + 1];
+  size_t pos = 0, len, count;
+
+  if (s->decode || capacity < StreamBound (size))
+    return 0;
+
+  if (size > 0 && !Wake (s))
+    return 0;
+
+  while (size > 0)
+  {
+    len = (size < STREAM_CHUNK) ? size : STREAM_CHUNK;
+    count = 0;
+
+    if (s->held != NO_PHRASE)
+      codes[count++] = (uint16_t)s->held;
+
+    count += (s->flags & FAST_MODE) ? s->kernels->encode_block_fast (&s->es, src, len, codes + count)
+                                    : s->kernels->encode_block (&s->es, src, len, codes + count);
+
+    pos += s->kernels->pack_codes (codes, count & ~(size_t)1, dst + pos);
+    s->held = (count & 1) ? codes[count - 1] : NO_PHRASE;
+
+    src += len;
+    size -= len;
+  }
+
+  *outSize = pos;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+/* Closes the stream with EOF_CODE and makes it ready for a new one. */
+int StreamFinish (struct lzwStream *s, void *out, size_t capacity, size_t *outSize)
+{
+  uint16_t codes[3];
+  size_t count = 0;
+
+  if (s->decode || capacity < StreamBound (0))
+    return 0;
+
+  if (s->held != NO_PHRASE)
+    codes[count++] = (uint16_t)s->held;
+
+  if (s->es.CurCode != NO_PHRASE)
+    codes[count++] = (uint16_t)s->es.CurCode;
+
+  codes[count++] = EOF_CODE;
+
+  *outSize = s->kernels->pack_codes (codes, count, (uint8_t *)out);
+
+  FreeEncodeState (&s->es);
+  free (s->image);
+  s->image = NULL;
+  s->imageSize = 0;
+  s->es.RunCode = 256;
+  s->es.CurCode = NO_PHRASE;
+  s->held = NO_PHRASE;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int StreamDecompress (struct lzwStream *s, const void *in, size_t size, size_t *used,
+                      void *out, size_t capacity, size_t *outSize)
+{
+  const uint8_t *src = (const uint8_t *)in;
+  uint8_t *dst = (uint8_t *)out;
+  size_t i = 0, pos = 0;
+  int code, n;
+
+  if (!s->decode)
+    return 0;
+
+  if (!s->ended && (size > 0 || s->pending != NO_PHRASE) && !Wake (s))
+    return 0;
+
+  while (!s->ended)
+  {
+    if (s->pending != NO_PHRASE)
+    {
+      code = s->pending;
+      s->pending = NO_PHRASE;
+    }
+    else
+    {
+      if (i == size)
+        break;
+
+      /* two codes in 3 bytes, low bits first */
+      if (s->phase == 0)
+      {
+        s->bits = src[i++];
+        s->phase = 1;
+        continue;
+      }
+      else if (s->phase == 1)
+      {
+        code = s->bits | ((src[i] & 0x0F) << 8);
+        s->bits = (uint16_t)(src[i++] >> 4);
+        s->phase = 2;
+      }
+      else
+      {
+        code = s->bits | (src[i++] << 4);
+        s->phase = 0;
+      }
+    }
+
+    if (code == EOF_CODE)
+      s->ended = 1;
+    else if (code == HT_CLEAR_CODE)
+      ResetUnpackHelper (s->uh);
+    else if ((n = ExpandCode (s->uh, (uint16_t)code, dst + pos, capacity - pos)) >= 0)
+      pos += n;
+    else if (pos > 0 || capacity < HT_MAX_CODE)
+    {
+      /* does not fit; the next call starts with it */
+      s->pending = code;
+      break;
+    }
+    else
+    {
+      fprintf (stderr, "Corrupt input.\n");
+      return 0;
+    }
+  }
+
+  *used = i;
+  *outSize = pos;
+
+  return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int StreamEnded (const struct lzwStream *s)
+{
+  return s->ended;
+}